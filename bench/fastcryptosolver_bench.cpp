@@ -0,0 +1,614 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+#include "solverengine.h"
+
+// Microbenchmarks of the hot kernels of the solver and end-to-end solves on the bundled
+// wordlists. Every benchmark is repeated until it ran for the minimum time, the results go
+// to stdout as a table and with --json to a file, one JSON object per line.
+
+constexpr const char* defaultWordlistDir = "../wordlist";
+constexpr const char* benchCryptogram = "TUQS MGZI BHDDWA MGZSP ZI GUVT";
+// a full key of benchCryptogram: EARN THIS BLOODY THINK IS HAVE
+constexpr const char* benchCryptogramKey = "YB*O**HLS***T**KR*NEAVD**I";
+
+// every allocation of the process, the kernels are measured by the difference
+std::atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* retVal = malloc(size == 0 ? 1 : size);
+    if (!retVal)
+    {
+        throw std::bad_alloc();
+    }
+    return retVal;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+// Hardware counters of the calling thread through perf_event_open, unavailable without
+// kernel support or when perf_event_paranoid forbids them
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        Cycles,
+        CacheMisses,
+        BranchMisses,
+        NumCounters
+    };
+
+    PerfCounters()
+    {
+#ifdef __linux__
+        const unsigned long long configs[NumCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for(int index = 0; index < NumCounters; ++index)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[index];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[index] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+        for(int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    bool isAvailable(Counter counter) const
+    {
+        return fds[counter] >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for(int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        for(int index = 0; index < NumCounters; ++index)
+        {
+            values[index] = 0;
+            if (fds[index] >= 0)
+            {
+                ioctl(fds[index], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(fds[index], &values[index], sizeof(values[index])) != sizeof(values[index]))
+                {
+                    values[index] = 0;
+                }
+            }
+        }
+#endif
+    }
+
+    unsigned long long value(Counter counter) const
+    {
+        return values[counter];
+    }
+
+private:
+    int fds[NumCounters] = {-1, -1, -1};
+    unsigned long long values[NumCounters] = {0, 0, 0};
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    size_t iterations = 0;
+    double nsPerOp = 0.0;
+    double bytesPerOp = 0.0;        // input bytes of one operation, 0 if it has no byte size
+    double allocationsPerOp = 0.0;
+    double counterPerOp[PerfCounters::NumCounters] = {-1.0, -1.0, -1.0};    // -1 if unavailable
+
+    double opsPerSecond() const
+    {
+        return nsPerOp > 0 ? 1e9 / nsPerOp : 0.0;
+    }
+};
+
+struct BenchmarkOptions
+{
+    std::string wordlistDir = defaultWordlistDir;
+    std::string filter;
+    std::string jsonFile;
+    double minTimeMs = 200.0;
+    bool skipSolves = false;
+};
+
+// keeps the results of the kernels alive so the compiler can not drop them
+volatile size_t benchmarkSink = 0;
+
+// op(iteration) is one operation. The iteration count doubles until a run takes a tenth of
+// the minimum time, the measured run is then scaled to the minimum time.
+template<typename Operation>
+BenchmarkResult runBenchmark(const std::string& name, double bytesPerOp, PerfCounters& counters, const BenchmarkOptions& options,
+                             Operation op)
+{
+    BenchmarkResult retVal;
+    retVal.name = name;
+    retVal.bytesPerOp = bytesPerOp;
+    size_t sink = 0;
+    size_t iterations = 1;
+    for(;;)
+    {
+        const auto tpBegin = std::chrono::steady_clock::now();
+        for(size_t iteration = 0; iteration < iterations; ++iteration)
+        {
+            sink += op(iteration);
+        }
+        const double elapsedMs = getElapsedMs(tpBegin);
+        if (elapsedMs >= options.minTimeMs / 10)
+        {
+            iterations = std::max<size_t>(1, static_cast<size_t>(iterations * options.minTimeMs / elapsedMs));
+            break;
+        }
+        iterations *= 2;
+    }
+
+    const size_t allocationsBefore = allocationCount.load();
+    counters.start();
+    const auto tpBegin = std::chrono::steady_clock::now();
+    for(size_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        sink += op(iteration);
+    }
+    const double elapsedMs = getElapsedMs(tpBegin);
+    counters.stop();
+    const size_t allocations = allocationCount.load() - allocationsBefore;
+    benchmarkSink = benchmarkSink + sink;
+
+    retVal.iterations = iterations;
+    retVal.nsPerOp = elapsedMs * 1e6 / iterations;
+    retVal.allocationsPerOp = static_cast<double>(allocations) / iterations;
+    for(int counter = 0; counter < PerfCounters::NumCounters; ++counter)
+    {
+        if (counters.isAvailable(static_cast<PerfCounters::Counter>(counter)))
+        {
+            retVal.counterPerOp[counter] = static_cast<double>(counters.value(static_cast<PerfCounters::Counter>(counter))) / iterations;
+        }
+    }
+    return retVal;
+}
+
+void printResult(const BenchmarkResult& result)
+{
+    std::cout << std::left << std::setw(44) << result.name << std::right << std::fixed
+        << std::setprecision(1) << std::setw(14) << result.nsPerOp << " ns/op"
+        << std::setprecision(0) << std::setw(14) << result.opsPerSecond() << " op/s";
+    if (result.bytesPerOp > 0)
+    {
+        std::cout << std::setprecision(1) << std::setw(10) << result.bytesPerOp * result.opsPerSecond() / 1024 / 1024 << " MB/s";
+    }
+    else
+    {
+        std::cout << std::setw(15) << "";
+    }
+    std::cout << std::setprecision(2) << std::setw(10) << result.allocationsPerOp << " alloc/op";
+    if (result.counterPerOp[PerfCounters::Cycles] >= 0)
+    {
+        std::cout << std::setprecision(0) << std::setw(12) << result.counterPerOp[PerfCounters::Cycles] << " cycles/op";
+    }
+    std::cout << std::endl;
+}
+
+std::string resultToJson(const BenchmarkResult& result)
+{
+    static const char* counterNames[PerfCounters::NumCounters] = {"cycles_per_op", "cache_misses_per_op", "branch_misses_per_op"};
+    std::ostringstream json;
+    json << std::setprecision(3) << std::fixed << "{\"name\":\"" << result.name << "\",\"iterations\":" << result.iterations
+        << ",\"ns_per_op\":" << result.nsPerOp << ",\"ops_per_s\":" << result.opsPerSecond()
+        << ",\"bytes_per_s\":" << result.bytesPerOp * result.opsPerSecond() << ",\"allocations_per_op\":" << result.allocationsPerOp;
+    for(int counter = 0; counter < PerfCounters::NumCounters; ++counter)
+    {
+        json << ",\"" << counterNames[counter] << "\":";
+        if (result.counterPerOp[counter] >= 0)
+        {
+            json << result.counterPerOp[counter];
+        }
+        else
+        {
+            json << "null";
+        }
+    }
+    json << "}";
+    return json.str();
+}
+
+// Every step-th word of the list, at most count of them
+std::vector<Word> sampleWords(const WordList& wordList, size_t count)
+{
+    std::vector<Word> retVal;
+    const size_t step = std::max<size_t>(1, wordList.size() / count);
+    for(size_t index = 0; index < wordList.size() && retVal.size() < count; index += step)
+    {
+        retVal.emplace_back((wordList.begin() + index)->first);
+    }
+    return retVal;
+}
+
+bool parseBenchmarkOptions(int argc, char* argv[], BenchmarkOptions& options)
+{
+    for(int index = 1; index < argc; ++index)
+    {
+        const std::string argument = argv[index];
+        const bool hasValue = index + 1 < argc;
+        if (argument == "--wordlist-dir" && hasValue)
+        {
+            options.wordlistDir = argv[++index];
+        }
+        else if (argument == "--filter" && hasValue)
+        {
+            options.filter = argv[++index];
+        }
+        else if (argument == "--json" && hasValue)
+        {
+            options.jsonFile = argv[++index];
+        }
+        else if (argument == "--min-time-ms" && hasValue)
+        {
+            options.minTimeMs = atof(argv[++index]);
+            if (options.minTimeMs <= 0)
+            {
+                return false;
+            }
+        }
+        else if (argument == "--no-solves")
+        {
+            options.skipSolves = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    if (!parseBenchmarkOptions(argc, argv, options))
+    {
+        std::cout << "Usage: " << argv[0] << " [--wordlist-dir DIR] [--filter TEXT] [--json FILE] [--min-time-ms MS] [--no-solves]" << std::endl;
+        return 1;
+    }
+    const std::string smallWordlist = options.wordlistDir + "/google-10000-english-usa.txt";
+    const std::string largeWordlist = options.wordlistDir + "/english_small.txt";
+    const Dictionary dictionary = createDictionary({ smallWordlist });
+    const DictionaryTier& tier = loadDictionaryTier(dictionary, 0);
+    if (tier.wordList.size() == 0)
+    {
+        std::cerr << "Error loading " << smallWordlist << std::endl;
+        return 1;
+    }
+    // the frequency mutator falls back to uniform draws when the tier has no letter counts,
+    // which would make both climb mutations and their benchmarks the same
+    {
+        const FrequencyMutator<ALPHABET_LETTERS_NUM> frequencyMutator(tier);
+        const UniformMutator<ALPHABET_LETTERS_NUM> uniformMutator(tier);
+        std::default_random_engine frequencyRng(42);
+        std::default_random_engine uniformRng(42);
+        LetterCounts frequencyDraws{};
+        LetterCounts uniformDraws{};
+        for(size_t draw = 0; draw < 100 * ALPHABET_LETTERS_NUM; ++draw)
+        {
+            frequencyDraws[frequencyMutator.pickLetter(frequencyRng) - 'A']++;
+            uniformDraws[uniformMutator.pickLetter(uniformRng) - 'A']++;
+        }
+        if (tier.letterFrequencies.size() != ALPHABET_LETTERS_NUM || frequencyDraws == uniformDraws
+            || frequencyDraws['E' - 'A'] <= 2 * frequencyDraws['Q' - 'A'] + 100)
+        {
+            std::cerr << "Error: the letter frequencies of " << smallWordlist << " do not weigh the mutations" << std::endl;
+            return 1;
+        }
+    }
+
+    PerfCounters counters;
+    std::vector<BenchmarkResult> results;
+    auto add = [&](const std::string& name, double bytesPerOp, const std::function<BenchmarkResult(const std::string&, double)>& run)
+    {
+        if (options.filter.empty() || name.find(options.filter) != std::string::npos)
+        {
+            results.emplace_back(run(name, bytesPerOp));
+            printResult(results.back());
+        }
+    };
+
+    const std::vector<Word> words = sampleWords(tier.wordList, 1024);
+    std::vector<TextView> missingWords;
+    std::vector<Word> missingStorage;
+    for(const Word& word : words)
+    {
+        Word missing = word;
+        missing.push_back('Q');
+        missingStorage.emplace_back(missing);
+    }
+    for(const Word& word : missingStorage)
+    {
+        missingWords.emplace_back(word);
+    }
+    double averageWordBytes = 0;
+    for(const Word& word : words)
+    {
+        averageWordBytes += word.size();
+    }
+    averageWordBytes /= words.size();
+
+    add("getWordPattern", averageWordBytes, [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t iteration) -> size_t
+        {
+            return getWordPattern(words[iteration % words.size()]).size();
+        });
+    });
+    add("Word::hasher", averageWordBytes, [&](const std::string& name, double bytes)
+    {
+        const Word::hasher hasher;
+        return runBenchmark(name, bytes, counters, options, [&](size_t iteration) -> size_t
+        {
+            return hasher(words[iteration % words.size()]);
+        });
+    });
+    add("WordList::find hit", averageWordBytes, [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t iteration) -> size_t
+        {
+            return tier.wordList.find(words[iteration % words.size()]) != tier.wordList.end();
+        });
+    });
+    add("WordList::find miss", averageWordBytes + 1, [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t iteration) -> size_t
+        {
+            return tier.wordList.find(missingWords[iteration % missingWords.size()]) != tier.wordList.end();
+        });
+    });
+
+    const std::string cryptoText = benchCryptogram;
+    CryptogramWords cryptogram = prepareCryptogramWords(cryptoText, dictionary, 0);
+    const CryptoKey solutionKey = cryptogram.keysPerWord[0].front();
+    add("transformText", static_cast<double>(cryptoText.size()), [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            return transformText<ALPHABET_LETTERS_NUM>(cryptoText, solutionKey).size();
+        });
+    });
+    const CryptoText plaintext = transformText<ALPHABET_LETTERS_NUM>(cryptoText, solutionKey);
+    add("calcTextQuality", static_cast<double>(plaintext.size()), [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            return static_cast<size_t>(calcTextQuality(plaintext, tier.wordList) * 1000);
+        });
+    });
+
+    // the same text without word breaks, segmented from scratch and after every mutation
+    std::string cryptoLetters = cryptoText;
+    cryptoLetters.erase(std::remove_if(cryptoLetters.begin(), cryptoLetters.end(), [](char chr) { return !isCipherLetter(chr); }),
+                        cryptoLetters.end());
+    const CryptoKey fullKey(benchCryptogramKey, ALPHABET_LETTERS_NUM);
+    const CryptoText plainLetters = transformText<ALPHABET_LETTERS_NUM>(cryptoLetters, fullKey);
+    // a cover by rare and short words is no solution, the plaintext of the benchmark is one
+    {
+        const SegmentationIndex& index = getSegmentationIndex(tier);
+        const std::string nonsense = "TOIFREGSUBAPMWAXTOIFREGSUBAPMWAX";
+        bool nonsenseSolved = true;
+        bool plaintextSolved = false;
+        getSegmentedText(nonsense, index, nullptr, &nonsenseSolved);
+        getSegmentedText(plainLetters, index, nullptr, &plaintextSolved);
+        if (nonsenseSolved || !plaintextSolved)
+        {
+            std::cerr << "Error: the segmentation " << (nonsenseSolved ? "solves a nonsense text" : "does not solve " + std::string(plainLetters.c_str())) << std::endl;
+            return 1;
+        }
+    }
+    add("getSegmentedText", static_cast<double>(plainLetters.size()), [&](const std::string& name, double bytes)
+    {
+        const SegmentationIndex& index = getSegmentationIndex(tier);
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            return getSegmentedText(plainLetters, index).size();
+        });
+    });
+    add("MutateKey + SegmentationScorer::score", static_cast<double>(plainLetters.size()), [&](const std::string& name, double bytes)
+    {
+        const ActiveLetters activeLetters = getActiveLetters(cryptoLetters);
+        const FrequencyMutator<ALPHABET_LETTERS_NUM> mutator(tier);
+        SegmentationScorer scorer(tier);
+        TextBuffer<TextSizeClass::Long> decrypted(cryptoLetters.size());
+        std::default_random_engine rng(42);
+        std::set<char> goodPositions;
+        CryptoKeyData keyData(fullKey, 0);
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            keyData = MutateKey(keyData, goodPositions, mutator, activeLetters, rng);
+            return static_cast<size_t>(scorer.score(cryptoLetters, keyData.first, decrypted) * 1000);
+        });
+    });
+
+    // the candidates of two words sharing letters, as the join sees them
+    const CryptoKeyList& keys1 = cryptogram.keysPerWord[1];
+    const CryptoKeyList& keys2 = cryptogram.keysPerWord[3];
+    add("combineTwoKeys", 0, [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t iteration) -> size_t
+        {
+            return combineTwoKeys(keys1[iteration % keys1.size()], keys2[(iteration / keys1.size()) % keys2.size()], false).size();
+        });
+    });
+    add("combineTwoKeyLists", 0, [&](const std::string& name, double bytes)
+    {
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            return combineTwoKeyLists(keys1, keys2).size();
+        });
+    });
+
+    add("MutateKey frequency", 0, [&](const std::string& name, double bytes)
+    {
+        const ActiveLetters activeLetters = getActiveLetters(cryptoText);
+        const FrequencyMutator<ALPHABET_LETTERS_NUM> mutator(tier);
+        std::default_random_engine rng(42);
+        std::set<char> goodPositions;
+        CryptoKeyData keyData(solutionKey, 0);
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            keyData = MutateKey(keyData, goodPositions, mutator, activeLetters, rng);
+            return keyData.first.at(0);
+        });
+    });
+    add("MutateKey uniform", 0, [&](const std::string& name, double bytes)
+    {
+        const ActiveLetters activeLetters = getActiveLetters(cryptoText);
+        const UniformMutator<ALPHABET_LETTERS_NUM> mutator(tier);
+        std::default_random_engine rng(42);
+        std::set<char> goodPositions;
+        CryptoKeyData keyData(solutionKey, 0);
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            keyData = MutateKey(keyData, goodPositions, mutator, activeLetters, rng);
+            return keyData.first.at(0);
+        });
+    });
+
+    add("SeenKeyFilter::testAndSet", 0, [&](const std::string& name, double bytes)
+    {
+        const ActiveLetters activeLetters = getActiveLetters(cryptoText);
+        const FrequencyMutator<ALPHABET_LETTERS_NUM> mutator(tier);
+        std::default_random_engine rng(42);
+        std::set<char> goodPositions;
+        CryptoKeyData keyData(solutionKey, 0);
+        SeenKeyFilter seenKeys(SolverOptions().seenKeyFilterKB * 1024);
+        return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+        {
+            keyData = MutateKey(keyData, goodPositions, mutator, activeLetters, rng);
+            return seenKeys.testAndSet(keyData.first);
+        });
+    });
+
+    if (!options.skipSolves)
+    {
+        // the exhaustive join over the large list takes minutes on this puzzle
+        struct SolveBenchmark
+        {
+            const std::string& wordlist;
+            SolverMode mode;
+            const char* modeName;
+        };
+        const SolveBenchmark solves[] = {
+            {smallWordlist, SolverMode::Exhaustive, "exhaustive"},
+            {smallWordlist, SolverMode::BestFirst, "best-first"},
+            {largeWordlist, SolverMode::BestFirst, "best-first"}
+        };
+        std::shared_ptr<const DictionaryContext> context;
+        for(const SolveBenchmark& solve : solves)
+        {
+            const std::string listName = solve.wordlist.substr(solve.wordlist.find_last_of('/') + 1);
+            const std::string name = std::string("solve ") + solve.modeName + " " + listName;
+            if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            {
+                continue;
+            }
+            std::string error;
+            if (!context || context->tierFileName(0) != solve.wordlist)
+            {
+                context = DictionaryContext::load({ solve.wordlist }, true, &error);
+            }
+            if (!context)
+            {
+                std::cerr << error << std::endl;
+                continue;
+            }
+            const Solver solver(context);
+            SolverOptions solverOptions;
+            solverOptions.mode = solve.mode;
+            add(name, 0, [&](const std::string& name, double bytes)
+            {
+                return runBenchmark(name, bytes, counters, options, [&](size_t) -> size_t
+                {
+                    return solver.solve(cryptoText, solverOptions).solutions;
+                });
+            });
+        }
+    }
+
+    if (!options.jsonFile.empty())
+    {
+        std::ofstream json(options.jsonFile, std::ios::trunc);
+        for(const BenchmarkResult& result : results)
+        {
+            json << resultToJson(result) << '\n';
+        }
+        if (!json)
+        {
+            std::cerr << "Error writing " << options.jsonFile << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,476 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <sys/resource.h>
+#include "solverengine.h"
+
+// Synthetic cryptogram corpus and the regression harness that runs a solver mode over it.
+// "generate" samples sentences from a wordlist and encrypts each with its own random key,
+// "run" solves every puzzle of a corpus and reports the solve rate, the time to the
+// correct plaintext and the peak memory, and with --shards whether the shards of a solve
+// find the same keys as the solve. A corpus line is the plaintext, the ciphertext and the
+// key (as SolverResult reports keys) separated by tabs, '#' starts a comment.
+
+constexpr const char* defaultWordlistName = "../wordlist/google-10000-english-usa.txt";
+constexpr const char* largeWordlistName = "../wordlist/english_small.txt";
+
+struct CorpusOptions
+{
+    std::string command;
+    std::string corpusFile;
+    std::string wordlist = defaultWordlistName;
+    std::string jsonFile;
+    size_t count = 100;
+    size_t minWords = 3;
+    size_t maxWords = 8;
+    size_t minWordLength = 2;
+    size_t maxWordLength = 12;
+    size_t maxRank = 2000;              // words are drawn from the maxRank most frequent ones
+    unsigned int seed = 1;
+    size_t shards = 0;                  // compare the keys of every solve with its shards, 0 for no check
+    SolverOptions solver;
+};
+
+struct CorpusPuzzle
+{
+    std::string plaintext;
+    std::string ciphertext;
+    std::string key;
+};
+
+void printCorpusUsage(const char* programName)
+{
+    std::cout << "Usage: " << programName << " generate --out FILE [--count N] [--words MIN-MAX] [--word-length MIN-MAX]" << std::endl
+        << "                 [--max-rank N] [--seed S] [--wordlist FILE]" << std::endl
+        << "       " << programName << " run --corpus FILE [--mode MODE] [--time-limit-ms MS] [--max-memory MB]" << std::endl
+        << "                 [--climb-mutation frequency|uniform] [--climb-acceptance walk|plateau]" << std::endl
+        << "                 [--max-unknown-words K] [--shards N] [--wordlist FILE]... [--json FILE]" << std::endl;
+}
+
+bool parseRange(const char* text, size_t& outMin, size_t& outMax)
+{
+    char* end = nullptr;
+    outMin = strtoul(text, &end, 10);
+    outMax = *end == '-' ? strtoul(end + 1, &end, 10) : outMin;
+    return *end == 0 && outMin > 0 && outMin <= outMax;
+}
+
+bool parseCorpusOptions(int argc, char* argv[], CorpusOptions& options, std::vector<std::string>& outWordlists)
+{
+    if (argc < 2)
+    {
+        return false;
+    }
+    options.command = argv[1];
+    for(int index = 2; index < argc; ++index)
+    {
+        const std::string argument = argv[index];
+        const bool hasValue = index + 1 < argc;
+        if ((argument == "--out" || argument == "--corpus") && hasValue)
+        {
+            options.corpusFile = argv[++index];
+        }
+        else if (argument == "--count" && hasValue)
+        {
+            options.count = strtoul(argv[++index], nullptr, 10);
+        }
+        else if (argument == "--words" && hasValue)
+        {
+            if (!parseRange(argv[++index], options.minWords, options.maxWords))
+            {
+                return false;
+            }
+        }
+        else if (argument == "--word-length" && hasValue)
+        {
+            if (!parseRange(argv[++index], options.minWordLength, options.maxWordLength))
+            {
+                return false;
+            }
+        }
+        else if (argument == "--max-rank" && hasValue)
+        {
+            options.maxRank = strtoul(argv[++index], nullptr, 10);
+        }
+        else if (argument == "--seed" && hasValue)
+        {
+            options.seed = static_cast<unsigned int>(strtoul(argv[++index], nullptr, 10));
+        }
+        else if (argument == "--wordlist" && hasValue)
+        {
+            outWordlists.emplace_back(argv[++index]);
+        }
+        else if (argument == "--json" && hasValue)
+        {
+            options.jsonFile = argv[++index];
+        }
+        else if (argument == "--mode" && hasValue)
+        {
+            const std::string mode = argv[++index];
+            if (mode == "exhaustive")
+            {
+                options.solver.mode = SolverMode::Exhaustive;
+            }
+            else if (mode == "beam")
+            {
+                options.solver.mode = SolverMode::Beam;
+            }
+            else if (mode == "best-first")
+            {
+                options.solver.mode = SolverMode::BestFirst;
+            }
+            else if (mode == "climb")
+            {
+                options.solver.mode = SolverMode::Climb;
+            }
+            else if (mode == "patristocrat")
+            {
+                options.solver.mode = SolverMode::Patristocrat;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (argument == "--climb-mutation" && hasValue)
+        {
+            const std::string mutation = argv[++index];
+            if (mutation == "frequency")
+            {
+                options.solver.climbMutation = ClimbMutation::Frequency;
+            }
+            else if (mutation == "uniform")
+            {
+                options.solver.climbMutation = ClimbMutation::Uniform;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (argument == "--climb-acceptance" && hasValue)
+        {
+            const std::string acceptance = argv[++index];
+            if (acceptance == "walk")
+            {
+                options.solver.climbAcceptance = ClimbAcceptance::RandomWalk;
+            }
+            else if (acceptance == "plateau")
+            {
+                options.solver.climbAcceptance = ClimbAcceptance::Plateau;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (argument == "--time-limit-ms" && hasValue)
+        {
+            options.solver.timeLimitMs = atof(argv[++index]);
+        }
+        else if (argument == "--max-memory" && hasValue)
+        {
+            options.solver.memoryLimitMB = strtoul(argv[++index], nullptr, 10);
+        }
+        else if (argument == "--max-unknown-words" && hasValue)
+        {
+            options.solver.maxUnknownWords = strtoul(argv[++index], nullptr, 10);
+        }
+        else if (argument == "--shards" && hasValue)
+        {
+            options.shards = strtoul(argv[++index], nullptr, 10);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    // only the shards of an exhaustive solve add up to the solve
+    return !options.corpusFile.empty() && (options.command == "generate" || options.command == "run")
+        && (options.shards == 0 || options.solver.mode == SolverMode::Exhaustive);
+}
+
+// A random permutation from addRandomKey is the decryption key, its inverse encrypts
+CorpusPuzzle encryptPuzzle(const std::string& plaintext, std::default_random_engine& rng)
+{
+    CorpusPuzzle retVal;
+    retVal.plaintext = plaintext;
+    CryptoKeySet keys;
+    addRandomKey<ALPHABET_LETTERS_NUM>(keys, getActiveLetters(std::string("ABCDEFGHIJKLMNOPQRSTUVWXYZ")), rng);
+    const CryptoKey& decryptionKey = *keys.begin();
+    CryptoKey encryptionKey(decryptionKey);
+    for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+    {
+        encryptionKey.at(decryptionKey.at(index) - 'A') = static_cast<char>('A' + index);
+    }
+    retVal.ciphertext = transformText<ALPHABET_LETTERS_NUM>(plaintext, encryptionKey);
+    const ActiveLetters activeLetters = getActiveLetters(retVal.ciphertext);
+    for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+    {
+        retVal.key.push_back(activeLetters.present[index] ? decryptionKey.at(index) : '*');
+    }
+    return retVal;
+}
+
+int generateCorpus(const CorpusOptions& options)
+{
+    const Dictionary dictionary = createDictionary({ options.wordlist });
+    const DictionaryTier& tier = loadDictionaryTier(dictionary, 0);
+    std::vector<Word> pool;       // in the order of the wordlist, so a seed gives the same corpus
+    for(const WordList::value_type& entry : tier.wordList)
+    {
+        const Word& word = entry.first;
+        const bool lettersOnly = std::all_of(word.c_str(), word.c_str() + word.size(), [](char chr) { return chr >= 'A' && chr <= 'Z'; });
+        if (entry.second < options.maxRank && lettersOnly && word.size() >= options.minWordLength && word.size() <= options.maxWordLength)
+        {
+            pool.emplace_back(word);
+        }
+    }
+    if (pool.empty())
+    {
+        std::cerr << "No word of " << options.wordlist << " fits the rank and length limits" << std::endl;
+        return 1;
+    }
+
+    std::ofstream output(options.corpusFile, std::ios::trunc);
+    output << "# fastcryptosolver corpus: " << options.count << " puzzles of " << options.minWords << "-" << options.maxWords
+        << " words, " << options.minWordLength << "-" << options.maxWordLength << " letters, rank below " << options.maxRank
+        << ", seed " << options.seed << '\n';
+    std::default_random_engine rng(options.seed);
+    std::uniform_int_distribution<size_t> wordCountDist(options.minWords, options.maxWords);
+    std::uniform_int_distribution<size_t> wordDist(0, pool.size() - 1);
+    for(size_t puzzle = 0; puzzle < options.count; ++puzzle)
+    {
+        std::string plaintext;
+        const size_t numWords = wordCountDist(rng);
+        for(size_t word = 0; word < numWords; ++word)
+        {
+            const Word& sample = pool[wordDist(rng)];
+            plaintext.append(word > 0 ? " " : "").append(sample.c_str(), sample.size());
+        }
+        const CorpusPuzzle encrypted = encryptPuzzle(plaintext, rng);
+        output << encrypted.plaintext << '\t' << encrypted.ciphertext << '\t' << encrypted.key << '\n';
+    }
+    if (!output)
+    {
+        std::cerr << "Error writing " << options.corpusFile << std::endl;
+        return 1;
+    }
+    std::cerr << "Wrote " << options.count << " puzzles to " << options.corpusFile << std::endl;
+    return 0;
+}
+
+bool readCorpus(const std::string& fileName, std::vector<CorpusPuzzle>& outPuzzles)
+{
+    std::ifstream input(fileName);
+    if (!input.is_open())
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(input, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        CorpusPuzzle puzzle;
+        std::istringstream fields(line);
+        if (std::getline(fields, puzzle.plaintext, '\t') && std::getline(fields, puzzle.ciphertext, '\t') && std::getline(fields, puzzle.key))
+        {
+            outPuzzles.emplace_back(puzzle);
+        }
+    }
+    return true;
+}
+
+// p-th percentile of sorted values, nearest rank
+double getPercentile(const std::vector<double>& sortedValues, double percentile)
+{
+    if (sortedValues.empty())
+    {
+        return 0.0;
+    }
+    const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sortedValues.size()));
+    return sortedValues[std::min(sortedValues.size(), std::max<size_t>(1, rank)) - 1];
+}
+
+// Letters of a plaintext, a patristocrat solve decides its own word breaks
+std::string getPlaintextLetters(const std::string& plaintext)
+{
+    std::string retVal = plaintext;
+    retVal.erase(std::remove_if(retVal.begin(), retVal.end(), [](char chr) { return !isCipherLetter(chr); }), retVal.end());
+    return retVal;
+}
+
+// All keys of a solve of ciphertext, or of its shardCount shards solved the way the command
+// line tool does: every shard searches the same pass and all of them go on to the next
+// pass only when none found a full key. false if a solve was stopped or cut at the memory
+// limit, its keys may be incomplete.
+bool getAllKeys(const Solver& solver, const std::string& ciphertext, const SolverOptions& options, size_t shardCount,
+                std::set<std::string>& outKeys)
+{
+    SolverOptions shardOptions = options;
+    shardOptions.maxSolutions = std::numeric_limits<size_t>::max();
+    shardOptions.shardCount = shardCount;
+    bool widen = true;
+    while (widen)
+    {
+        widen = false;
+        SearchPass nextPass;
+        for(size_t shard = 0; shard < shardCount; ++shard)
+        {
+            shardOptions.shardIndex = shard;
+            const SolverResult result = solver.solve(ciphertext, shardOptions);
+            if (result.interrupted || result.truncated)
+            {
+                return false;
+            }
+            for(const RankedKey& key : result.keys)
+            {
+                outKeys.insert(key.key);
+            }
+            if (result.hasNextPass)
+            {
+                widen = true;
+                nextPass = result.nextPass;
+            }
+        }
+        widen = widen && outKeys.empty();
+        shardOptions.shardPass = nextPass;
+    }
+    return true;
+}
+
+// A puzzle counts as solved when the correct plaintext shows up as the best key so far,
+// as a solution found during the search or among the final keys, whichever comes first.
+// In patristocrat mode only the letters are compared.
+int runCorpus(const CorpusOptions& options, const std::vector<std::string>& wordlists)
+{
+    std::vector<CorpusPuzzle> puzzles;
+    if (!readCorpus(options.corpusFile, puzzles))
+    {
+        std::cerr << "Error opening corpus " << options.corpusFile << std::endl;
+        return 1;
+    }
+    std::string error;
+    std::shared_ptr<const DictionaryContext> dictionary = DictionaryContext::load(wordlists, false, &error);
+    if (!dictionary)
+    {
+        std::cerr << "Error loading the wordlists: " << error << std::endl;
+        return 1;
+    }
+    const Solver solver(dictionary);
+
+    std::vector<double> solveTimes;
+    double totalMs = 0.0;
+    size_t shardMismatches = 0;
+    for(size_t index = 0; index < puzzles.size(); ++index)
+    {
+        const CorpusPuzzle& puzzle = puzzles[index];
+        const bool patristocrat = options.solver.mode == SolverMode::Patristocrat;
+        const std::string expected = patristocrat ? getPlaintextLetters(puzzle.plaintext) : puzzle.plaintext;
+        auto isCorrect = [&](const RankedKey& key) -> bool
+        {
+            return (patristocrat ? getPlaintextLetters(key.plaintext) : key.plaintext) == expected;
+        };
+        const auto tpBegin = std::chrono::steady_clock::now();
+        double correctMs = -1.0;
+        auto checkKey = [&](const RankedKey& key)
+        {
+            if (correctMs < 0 && isCorrect(key))
+            {
+                correctMs = getElapsedMs(tpBegin);
+            }
+        };
+        const SolverResult result = solver.solve(puzzle.ciphertext, options.solver, [&](const RankedKey& key, double)
+        {
+            checkKey(key);
+        }, checkKey);
+        for(const RankedKey& key : result.keys)
+        {
+            if (correctMs < 0 && isCorrect(key))
+            {
+                correctMs = result.solveMs;
+            }
+        }
+        totalMs += result.solveMs;
+        if (correctMs >= 0)
+        {
+            solveTimes.push_back(correctMs);
+        }
+        else
+        {
+            std::cerr << "Puzzle " << index + 1 << " not solved" << (result.interrupted ? " in time" : "") << ": " << puzzle.ciphertext << std::endl;
+        }
+        std::set<std::string> keys;
+        std::set<std::string> shardKeys;
+        if (options.shards > 0 && getAllKeys(solver, puzzle.ciphertext, options.solver, 1, keys)
+            && getAllKeys(solver, puzzle.ciphertext, options.solver, options.shards, shardKeys) && keys != shardKeys)
+        {
+            ++shardMismatches;
+            std::cerr << "Puzzle " << index + 1 << ": " << keys.size() << " keys, " << shardKeys.size() << " from "
+                << options.shards << " shards: " << puzzle.ciphertext << std::endl;
+        }
+    }
+    std::sort(solveTimes.begin(), solveTimes.end());
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const double solveRate = puzzles.empty() ? 0.0 : static_cast<double>(solveTimes.size()) / puzzles.size();
+    std::ostringstream json;
+    json << std::setprecision(3) << std::fixed << "{\"corpus\":\"" << options.corpusFile << "\",\"puzzles\":" << puzzles.size()
+        << ",\"solved\":" << solveTimes.size() << ",\"solve_rate\":" << solveRate
+        << ",\"p50_ms\":" << getPercentile(solveTimes, 50) << ",\"p95_ms\":" << getPercentile(solveTimes, 95)
+        << ",\"p99_ms\":" << getPercentile(solveTimes, 99) << ",\"total_ms\":" << totalMs
+        << ",\"peak_rss_kb\":" << usage.ru_maxrss;
+    if (options.shards > 0)
+    {
+        json << ",\"shard_mismatches\":" << shardMismatches;
+    }
+    json << "}";
+    std::cout << json.str() << std::endl;
+    if (!options.jsonFile.empty())
+    {
+        std::ofstream file(options.jsonFile, std::ios::trunc);
+        file << json.str() << std::endl;
+        if (!file)
+        {
+            std::cerr << "Error writing " << options.jsonFile << std::endl;
+            return 1;
+        }
+    }
+    return shardMismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    CorpusOptions options;
+    std::vector<std::string> wordlists;
+    if (!parseCorpusOptions(argc, argv, options, wordlists))
+    {
+        printCorpusUsage(argv[0]);
+        return 1;
+    }
+    if (options.command == "generate")
+    {
+        if (!wordlists.empty())
+        {
+            options.wordlist = wordlists.back();
+        }
+        return generateCorpus(options);
+    }
+    if (wordlists.empty())
+    {
+        wordlists = { defaultWordlistName, largeWordlistName };
+    }
+    return runCorpus(options, wordlists);
+}
@@ -0,0 +1,359 @@
+#ifndef _FASTCRYPTOSOLVER_H_
+#define _FASTCRYPTOSOLVER_H_
+
+// Embeddable cryptogram solver. A DictionaryContext is loaded once and shared by any number
+// of Solver instances and threads, a Solver turns a ciphertext into ranked keys. The
+// library does not write to the console, progress output is opt-in via setSolverLog.
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class SolverMode
+{
+    Exhaustive,
+    Beam,
+    BestFirst,
+    Climb,
+    Patristocrat    // climb over the letters alone for texts without word breaks, e.g. in groups of five
+};
+
+// Plain letter a climber mutation gives a cipher letter: drawn by its frequency in the
+// dictionary or uniformly from the alphabet
+enum class ClimbMutation
+{
+    Frequency,
+    Uniform
+};
+
+// Keys a walk of the climber goes on from until it finds a better one: every mutated key,
+// or only keys at least as good as its current one
+enum class ClimbAcceptance
+{
+    RandomWalk,
+    Plateau
+};
+
+// Shared by the caller and any number of running solves, which stop soon after cancel()
+class CancellationToken
+{
+public:
+    void cancel()
+    {
+        cancelled = true;
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled;
+    }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+class CandidateCache;
+class SolveCheckpoint;
+
+// Known plaintext of one or more consecutive words, for example the name a message is
+// signed with. Without a word index the crib may be at any place where it fits.
+struct Crib
+{
+    std::string plaintext;
+    int wordIndex = -1;         // index of the first word of the crib, -1 for anywhere
+};
+
+// One pass of the widening of an enumeration: every word takes its candidates from the
+// smallest dictionary tier from tier on that has any, and the words unknownWords (indexes
+// in the text) are treated as unknown besides the words without any dictionary match. A
+// solve starts with the first pass and only goes on to the next when it found no full key.
+struct SearchPass
+{
+    size_t tier = 0;
+    std::vector<size_t> unknownWords;
+};
+
+struct SolverOptions
+{
+    SolverMode mode = SolverMode::Exhaustive;
+    size_t beamWidth = 1000;
+    size_t memoryLimitMB = 1024;    // hard limit for the key lists of one solve call
+    size_t maxSolutions = 10;
+    size_t maxUnknownWords = 0;
+    double timeLimitMs = 0.0;       // wall-clock budget of one solve call, 0 for none (5 s for patristocrats under 25 letters)
+    std::shared_ptr<const CancellationToken> cancellation;
+    std::shared_ptr<CandidateCache> candidateCache;     // optional, keeps the word candidates between solves
+    std::string knownKey;           // plain letter for cipher letters A-Z, '*' if unknown, empty for none
+    std::vector<Crib> cribs;
+    size_t seenKeyFilterKB = 64;    // memory of the climber's filter of keys walked on, 0 scores every key
+    ClimbMutation climbMutation = ClimbMutation::Frequency;
+    ClimbAcceptance climbAcceptance = ClimbAcceptance::RandomWalk;
+    // Solves with shard indexes 0 to shardCount - 1 split the search between them without
+    // overlap: each only joins the candidates of the first planned word whose position in
+    // its list modulo shardCount is shardIndex. A shard only searches shardPass and never
+    // widens by itself, so in exhaustive mode the keys of all shards are the keys of one
+    // solve of that pass (beam and best-first shards prune on their own); when no shard
+    // found a full key the caller solves them again with the nextPass of their results. In
+    // climb mode they are independent climbs, seeded by shardIndex.
+    size_t shardIndex = 0;
+    size_t shardCount = 1;
+    SearchPass shardPass;
+    std::shared_ptr<SolveCheckpoint> checkpoint;    // optional, a climb keeps its state in it and resumes from it
+};
+
+struct RankedKey
+{
+    std::string key;            // plain letter for every cipher letter A-Z, '*' if not in the text
+    std::string plaintext;
+    double quality = 0.0;       // share of the plaintext letters in dictionary words
+};
+
+// Timings in milliseconds and counters of one solve. Every solve fills its own, merge adds
+// them up, so threads running many solves keep one each and merge them at the end.
+struct SolverMetrics
+{
+    struct WordCandidates
+    {
+        size_t word = 0;            // index of the word in the text
+        size_t candidates = 0;
+        double ms = 0.0;
+    };
+
+    struct JoinStep
+    {
+        size_t word = 0;            // index of the word joined
+        size_t inputKeys = 0;       // partial keys before the join
+        size_t candidates = 0;      // candidate keys of the word
+        size_t outputKeys = 0;
+        double ms = 0.0;
+    };
+
+    size_t solves = 0;
+    double candidateMs = 0.0;       // candidate keys of all words, including tiers loaded on demand
+    double searchMs = 0.0;          // joins or climbing
+    double rankMs = 0.0;
+    size_t candidateWords = 0;      // words that got candidates, once per tier pass
+    size_t joinSteps = 0;
+    size_t prunedKeys = 0;          // partial keys dropped by a conflict, a dead end or the beam
+    size_t scoringCalls = 0;        // keys scored against the dictionary
+    size_t mutations = 0;           // keys tried by the climber
+    double climbMs = 0.0;
+    size_t seenKeyChecks = 0;       // climber keys looked up in the filter of keys walked on
+    size_t seenKeyHits = 0;         // of them found and not scored again
+    std::vector<WordCandidates> words;  // of this solve only, merge keeps them as they are
+    std::vector<JoinStep> joins;
+
+    double mutationsPerSecond() const
+    {
+        return climbMs > 0 ? mutations * 1000.0 / climbMs : 0.0;
+    }
+
+    double seenKeyHitRate() const
+    {
+        return seenKeyChecks > 0 ? static_cast<double>(seenKeyHits) / seenKeyChecks : 0.0;
+    }
+
+    void merge(const SolverMetrics& other);
+};
+
+struct SolverResult
+{
+    std::vector<RankedKey> keys;    // best quality first, at most maxSolutions
+    size_t solutions = 0;           // distinct full keys found
+    size_t dictionaryTier = 0;      // widest tier the candidates came from
+    double solveMs = 0.0;
+    // stopped by the time limit or the cancellation before the search finished, the keys
+    // may be incomplete; without any full key keys holds the best partial key so far
+    bool interrupted = false;
+    bool truncated = false;         // a key list was cut at the memory limit, the keys may be incomplete
+    bool hasNextPass = false;       // of a sharded enumeration, the pass after SolverOptions::shardPass
+    SearchPass nextPass;
+    std::string error;              // why the ciphertext could not be searched at all
+    SolverMetrics metrics;
+
+    bool solved() const
+    {
+        return solutions > 0;
+    }
+};
+
+// Called for every full key as soon as it is found, with its cost in best-first mode
+using SolutionHandler = std::function<void(const RankedKey& key, double cost)>;
+
+// Called whenever the best key so far improves, partial keys decode only some words
+using ProgressHandler = std::function<void(const RankedKey& best)>;
+
+struct DictionaryTierMetrics
+{
+    std::string fileName;
+    bool loaded = false;        // the other members are 0 until a solve needs the tier
+    size_t words = 0;
+    double loadMs = 0.0;        // reading and parsing the wordlist
+    double patternMapMs = 0.0;
+};
+
+// Dictionary tiers from the smallest to the largest wordlist. Immutable once created and
+// safe to share between threads, tiers that were not preloaded are loaded exactly once
+// by the first solve that needs them.
+class DictionaryContext
+{
+public:
+    // nullptr if a wordlist can not be opened, the reason goes to outError
+    static std::shared_ptr<const DictionaryContext> load(const std::vector<std::string>& wordlists, bool preloadAllTiers,
+                                                         std::string* outError = nullptr);
+    ~DictionaryContext();
+
+    size_t tierCount() const;
+    const std::string& tierFileName(size_t tier) const;
+    std::vector<DictionaryTierMetrics> tierMetrics() const;
+
+private:
+    struct Tiers;
+
+    DictionaryContext();
+    DictionaryContext(const DictionaryContext&) = delete;
+    DictionaryContext& operator=(const DictionaryContext&) = delete;
+
+    std::unique_ptr<Tiers> tiers;
+    friend class Solver;
+};
+
+struct CandidateCacheStats
+{
+    size_t hits = 0;            // word patterns found in memory or in the loaded file
+    size_t misses = 0;
+    size_t patterns = 0;        // patterns held in memory
+    size_t bytes = 0;
+};
+
+class PatternCandidateCache;
+
+// Dictionary candidates of the cipher word patterns, shared by all solves that get it in
+// their options so a repeated word shape is only matched against the dictionary once.
+// Entries are keyed by the content of the dictionary tier, one cache serves reloaded or
+// different dictionaries. The least recently used patterns are dropped above the memory
+// limit. Thread-safe.
+class CandidateCache
+{
+public:
+    explicit CandidateCache(size_t memoryLimitMB = 256);
+    ~CandidateCache();
+
+    // Patterns saved by an earlier run become available, the file stays mapped and its
+    // entries are read on first use. false if it is missing or not a cache file.
+    bool load(const std::string& fileName, std::string* outError = nullptr);
+    // Patterns in memory and those of the loaded file, replaces fileName atomically
+    bool save(const std::string& fileName, std::string* outError = nullptr) const;
+    CandidateCacheStats stats() const;
+
+private:
+    CandidateCache(const CandidateCache&) = delete;
+    CandidateCache& operator=(const CandidateCache&) = delete;
+
+    std::unique_ptr<PatternCandidateCache> cache;
+    friend class Solver;
+};
+
+class CheckpointStore;
+
+// Progress of a long solve that survives a restart, kept in a compact binary file. The
+// enumeration modes record the finished shards (see SolverOptions::shardCount) with their
+// keys, for a caller that solves the shards one after the other. A climb that gets the
+// checkpoint in its options records its pool of best keys and the state of its random
+// generator, at most every saveIntervalMs and when it stops, and goes on from them. The
+// file is replaced atomically, an empty fileName keeps everything in memory. Thread-safe.
+class SolveCheckpoint
+{
+public:
+    SolveCheckpoint(const std::string& fileName, const std::string& ciphertext, SolverMode mode, size_t shardCount,
+                    double saveIntervalMs = 5000.0);
+    ~SolveCheckpoint();
+
+    // Takes over the state saved by an earlier run of the same ciphertext, mode and number
+    // of shards. false if the file is missing, truncated or belongs to another solve.
+    bool resume(std::string* outError = nullptr);
+    bool save(std::string* outError = nullptr) const;
+
+    bool isShardDone(size_t shardIndex) const;
+    size_t doneShards() const;
+    // Records a finished shard and saves the checkpoint. keys are the best keys of the shard
+    // (at most maxSolutions of them), solutions counts all its full keys, truncated whether
+    // the memory limit cut its key lists.
+    bool completeShard(size_t shardIndex, const std::vector<RankedKey>& keys, size_t solutions, bool truncated,
+                       std::string* outError = nullptr);
+    // The distinct keys recorded for the finished shards, best quality first. They hold the
+    // best maxSolutions keys of the whole solve but fewer than shardSolutions.
+    std::vector<RankedKey> shardKeys() const;
+    // full keys found by the finished shards
+    size_t shardSolutions() const;
+    // true if the memory limit cut the key lists of a finished shard
+    bool isTruncated() const;
+    // The pass the shards search, the first one until startPass
+    SearchPass pass() const;
+    // Remembers the pass after the current one, saved with the next finished shard
+    void setNextPass(const SearchPass& nextPass);
+    // false if the current pass is the widest or no shard told its next pass yet
+    bool getNextPass(SearchPass& outPass) const;
+    // Starts pass with no shard finished and no keys and saves the checkpoint, for a solve
+    // whose shards all found no full key in the current pass. The memory limit flag stays.
+    bool startPass(const SearchPass& pass, std::string* outError = nullptr);
+
+private:
+    SolveCheckpoint(const SolveCheckpoint&) = delete;
+    SolveCheckpoint& operator=(const SolveCheckpoint&) = delete;
+
+    std::unique_ptr<CheckpointStore> store;
+    friend class Solver;
+};
+
+// Stateless apart from the dictionary it holds, one instance can serve concurrent calls
+class Solver
+{
+public:
+    explicit Solver(std::shared_ptr<const DictionaryContext> dictionary);
+
+    SolverResult solve(const std::string& ciphertext, const SolverOptions& options,
+                       const SolutionHandler& onSolution = SolutionHandler(),
+                       const ProgressHandler& onProgress = ProgressHandler()) const;
+    const DictionaryContext& dictionaryContext() const
+    {
+        return *dictionary;
+    }
+
+private:
+    std::shared_ptr<const DictionaryContext> dictionary;
+};
+
+enum class LogLevel
+{
+    Error,
+    Info,           // dictionary loading, join steps, limits reached
+    Debug           // every key the climber keeps or drops
+};
+
+// Progress output of the engines goes to stream, written by a background thread. nullptr
+// (the default) silences it and costs nothing but a level check. Messages of solves still
+// running are dropped rather than waiting when the writer falls behind.
+void setSolverLog(std::ostream* stream, LogLevel level = LogLevel::Info);
+// Returns when every message logged before the call was written
+void flushSolverLog();
+
+// The CPUs the process may run on, grouped by NUMA node. From libnuma when the library was
+// built with it, otherwise from /sys/devices/system/node, a single node if neither knows.
+struct CpuTopology
+{
+    std::vector<std::vector<int>> nodeCpus;     // nodes without allowed CPUs are left out
+
+    size_t cpuCount() const;
+};
+
+CpuTopology getCpuTopology();
+// Restricts the calling thread, and the threads it starts later, to cpus. false if the
+// system refuses.
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+#endif
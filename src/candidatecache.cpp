@@ -0,0 +1,235 @@
+#include <fstream>
+#include <cstdio>
+#include "solverengine.h"
+
+// Cache file: the header, then the entries one after the other, all numbers little endian
+// as written by the machine. Entry: dictionary version (8 bytes), pattern length (1 byte),
+// pattern, number of candidates (4 bytes), the keys (26 bytes each), the ranks (4 bytes each).
+const char cacheFileMagic[8] = {'F', 'C', 'S', 'C', 'A', 'N', 'D', '1'};
+
+template<typename T>
+bool readCacheValue(TextView data, size_t& offset, T& outValue)
+{
+    if (data.size() - offset < sizeof(T))
+    {
+        return false;
+    }
+    memcpy(&outValue, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+template<typename T>
+void writeCacheValue(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+size_t getEntryBytes(const PatternCandidates& candidates)
+{
+    return sizeof(PatternCandidates) + 2 * sizeof(Word) + candidates.keys.size() * sizeof(CryptoKey)
+        + candidates.ranks.size() * sizeof(WordRank);
+}
+
+// data starts at the number of candidates of an entry
+std::shared_ptr<const PatternCandidates> readCandidates(TextView data)
+{
+    std::shared_ptr<PatternCandidates> retVal = std::make_shared<PatternCandidates>();
+    size_t offset = 0;
+    uint32_t count = 0;
+    readCacheValue(data, offset, count);
+    retVal->keys.reserve(count);
+    for(uint32_t index = 0; index < count; ++index)
+    {
+        retVal->keys.emplace_back(data.data() + offset, ALPHABET_LETTERS_NUM);
+        offset += ALPHABET_LETTERS_NUM;
+    }
+    retVal->ranks.resize(count);
+    memcpy(retVal->ranks.data(), data.data() + offset, count * sizeof(WordRank));
+    return retVal;
+}
+
+void writeEntry(std::ostream& stream, uint64_t dictionaryVersion, const Word& pattern, const PatternCandidates& candidates)
+{
+    writeCacheValue(stream, dictionaryVersion);
+    writeCacheValue(stream, static_cast<uint8_t>(pattern.size()));
+    stream.write(pattern.c_str(), pattern.size());
+    writeCacheValue(stream, static_cast<uint32_t>(candidates.keys.size()));
+    for(const CryptoKey& key : candidates.keys)
+    {
+        stream.write(key.c_str(), ALPHABET_LETTERS_NUM);
+    }
+    stream.write(reinterpret_cast<const char*>(candidates.ranks.data()), candidates.ranks.size() * sizeof(WordRank));
+}
+
+PatternCandidateCache::PatternCandidateCache(size_t memoryLimit) : memoryLimit(memoryLimit)
+{
+}
+
+std::shared_ptr<const PatternCandidates> PatternCandidateCache::find(uint64_t dictionaryVersion, const Word& pattern)
+{
+    const EntryKey key = {dictionaryVersion, pattern};
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entryIndex.find(key);
+    if (it != entryIndex.end())
+    {
+        entries.splice(entries.begin(), entries, it->second);
+        ++hits;
+        return it->second->candidates;
+    }
+    auto fileIt = fileIndex.find(key);
+    if (fileIt != fileIndex.end())
+    {
+        std::shared_ptr<const PatternCandidates> candidates = readCandidates(fileIt->second);
+        insertLocked(key, candidates);
+        ++hits;
+        return candidates;
+    }
+    ++misses;
+    return nullptr;
+}
+
+void PatternCandidateCache::insert(uint64_t dictionaryVersion, const Word& pattern, std::shared_ptr<const PatternCandidates> candidates)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    insertLocked({dictionaryVersion, pattern}, std::move(candidates));
+}
+
+// A pattern inserted by two solves at the same time keeps the first candidates. The
+// newest entry stays even if it alone is above the limit.
+void PatternCandidateCache::insertLocked(const EntryKey& key, std::shared_ptr<const PatternCandidates> candidates)
+{
+    if (entryIndex.find(key) != entryIndex.end())
+    {
+        return;
+    }
+    const size_t entryBytes = getEntryBytes(*candidates);
+    entries.push_front({key, std::move(candidates), entryBytes});
+    entryIndex[key] = entries.begin();
+    bytes += entryBytes;
+    while (bytes > memoryLimit && entries.size() > 1)
+    {
+        bytes -= entries.back().bytes;
+        entryIndex.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+bool PatternCandidateCache::load(const std::string& fileName, std::string* outError)
+{
+    auto fail = [&](const std::string& error) -> bool
+    {
+        if (outError)
+        {
+            *outError = error;
+        }
+        return false;
+    };
+    std::shared_ptr<const MappedFile> newFile = std::make_shared<MappedFile>(fileName);
+    if (!newFile->isOpen())
+    {
+        return fail("error opening candidate cache " + fileName);
+    }
+    const TextView data = newFile->view();
+    if (data.size() < sizeof(cacheFileMagic) || memcmp(data.data(), cacheFileMagic, sizeof(cacheFileMagic)) != 0)
+    {
+        return fail(fileName + " is not a candidate cache");
+    }
+    std::unordered_map<EntryKey, TextView, EntryKeyHasher> newIndex;
+    size_t offset = sizeof(cacheFileMagic);
+    while (offset < data.size())
+    {
+        EntryKey key;
+        uint8_t patternLength = 0;
+        uint32_t count = 0;
+        if (!readCacheValue(data, offset, key.dictionaryVersion) || !readCacheValue(data, offset, patternLength)
+            || patternLength > maxWordLength || data.size() - offset < patternLength)
+        {
+            return fail(fileName + " is truncated");
+        }
+        key.pattern = Word(data.data() + offset, patternLength);
+        offset += patternLength;
+        const size_t candidatesBegin = offset;
+        if (!readCacheValue(data, offset, count)
+            || (data.size() - offset) / (ALPHABET_LETTERS_NUM + sizeof(WordRank)) < count)
+        {
+            return fail(fileName + " is truncated");
+        }
+        offset += count * (ALPHABET_LETTERS_NUM + sizeof(WordRank));
+        newIndex[key] = data.substr(candidatesBegin, offset - candidatesBegin);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    file = std::move(newFile);
+    fileIndex = std::move(newIndex);
+    return true;
+}
+
+bool PatternCandidateCache::save(const std::string& fileName, std::string* outError) const
+{
+    const std::string tempFileName = fileName + ".tmp";
+    std::ofstream stream(tempFileName, std::ios::binary | std::ios::trunc);
+    if (stream.is_open())
+    {
+        stream.write(cacheFileMagic, sizeof(cacheFileMagic));
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const Entry& entry : entries)
+        {
+            writeEntry(stream, entry.key.dictionaryVersion, entry.key.pattern, *entry.candidates);
+        }
+        for(const auto& fileEntry : fileIndex)
+        {
+            if (entryIndex.find(fileEntry.first) == entryIndex.end())
+            {
+                writeCacheValue(stream, fileEntry.first.dictionaryVersion);
+                writeCacheValue(stream, static_cast<uint8_t>(fileEntry.first.pattern.size()));
+                stream.write(fileEntry.first.pattern.c_str(), fileEntry.first.pattern.size());
+                stream.write(fileEntry.second.data(), fileEntry.second.size());
+            }
+        }
+    }
+    stream.close();
+    if (!stream || std::rename(tempFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::remove(tempFileName.c_str());
+        if (outError)
+        {
+            *outError = "error writing candidate cache " + fileName;
+        }
+        return false;
+    }
+    return true;
+}
+
+CandidateCacheStats PatternCandidateCache::stats() const
+{
+    CandidateCacheStats retVal;
+    std::lock_guard<std::mutex> lock(mutex);
+    retVal.hits = hits;
+    retVal.misses = misses;
+    retVal.patterns = entries.size();
+    retVal.bytes = bytes;
+    return retVal;
+}
+
+CandidateCache::CandidateCache(size_t memoryLimitMB) : cache(new PatternCandidateCache(memoryLimitMB * 1024 * 1024))
+{
+}
+
+CandidateCache::~CandidateCache()
+{
+}
+
+bool CandidateCache::load(const std::string& fileName, std::string* outError)
+{
+    return cache->load(fileName, outError);
+}
+
+bool CandidateCache::save(const std::string& fileName, std::string* outError) const
+{
+    return cache->save(fileName, outError);
+}
+
+CandidateCacheStats CandidateCache::stats() const
+{
+    return cache->stats();
+}
@@ -0,0 +1,479 @@
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include "solverengine.h"
+
+// Checkpoint file: the header, then the solve it belongs to, the finished shards and the
+// climb, all numbers little endian as written by the machine. Strings are their length
+// (4 bytes) and their characters.
+// Solve: ciphertext, mode (1 byte), number of shards (4 bytes).
+// Pass: the one the shards search and 1 byte, not 0 if the next pass follows. A pass is
+// its dictionary tier (4 bytes), number of unknown words (4 bytes) and their indexes (4
+// bytes each).
+// Shards: number of finished shards (4 bytes) and their indexes (4 bytes each), full keys
+// found (8 bytes), 1 byte, not 0 if the memory limit cut a key list, number of keys
+// (4 bytes), every key as quality (8 bytes), key, plaintext.
+// Climb: 1 byte, 0 without a climb. Otherwise the root index (4 bytes), the random
+// generator, number of pool keys (4 bytes), every key as quality (8 bytes), mutations
+// (4 bytes), key.
+const char checkpointFileMagic[8] = {'F', 'C', 'S', 'C', 'K', 'P', 'T', '3'};
+
+template<typename T>
+bool readCheckpointValue(TextView data, size_t& offset, T& outValue)
+{
+    if (data.size() - offset < sizeof(T))
+    {
+        return false;
+    }
+    memcpy(&outValue, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+bool readCheckpointString(TextView data, size_t& offset, std::string& outValue)
+{
+    uint32_t length = 0;
+    if (!readCheckpointValue(data, offset, length) || data.size() - offset < length)
+    {
+        return false;
+    }
+    outValue.assign(data.data() + offset, length);
+    offset += length;
+    return true;
+}
+
+template<typename T>
+void writeCheckpointValue(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeCheckpointString(std::ostream& stream, const std::string& value)
+{
+    writeCheckpointValue(stream, static_cast<uint32_t>(value.size()));
+    stream.write(value.data(), value.size());
+}
+
+bool readCheckpointPass(TextView data, size_t& offset, SearchPass& outPass)
+{
+    uint32_t tier = 0;
+    uint32_t numWords = 0;
+    if (!readCheckpointValue(data, offset, tier) || !readCheckpointValue(data, offset, numWords))
+    {
+        return false;
+    }
+    outPass.tier = tier;
+    outPass.unknownWords.clear();
+    for(uint32_t index = 0; index < numWords; ++index)
+    {
+        uint32_t word = 0;
+        if (!readCheckpointValue(data, offset, word))
+        {
+            return false;
+        }
+        outPass.unknownWords.emplace_back(word);
+    }
+    return true;
+}
+
+void writeCheckpointPass(std::ostream& stream, const SearchPass& pass)
+{
+    writeCheckpointValue(stream, static_cast<uint32_t>(pass.tier));
+    writeCheckpointValue(stream, static_cast<uint32_t>(pass.unknownWords.size()));
+    for(size_t word : pass.unknownWords)
+    {
+        writeCheckpointValue(stream, static_cast<uint32_t>(word));
+    }
+}
+
+CheckpointStore::CheckpointStore(const std::string& fileName, const std::string& ciphertext, SolverMode mode, size_t shardCount,
+                                 double saveIntervalMs)
+    : fileName(fileName), ciphertext(ciphertext), mode(mode), shardCount(shardCount), saveIntervalMs(saveIntervalMs),
+      finishedShards(shardCount, false), lastSave(std::chrono::steady_clock::now())
+{
+}
+
+bool CheckpointStore::load(std::string* outError)
+{
+    auto fail = [&](const std::string& error) -> bool
+    {
+        if (outError)
+        {
+            *outError = error;
+        }
+        return false;
+    };
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.is_open())
+    {
+        return fail("error opening checkpoint " + fileName);
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    const std::string buffer = content.str();
+    const TextView data = buffer;
+    if (data.size() < sizeof(checkpointFileMagic) || memcmp(data.data(), checkpointFileMagic, sizeof(checkpointFileMagic)) != 0)
+    {
+        return fail(fileName + " is not a checkpoint");
+    }
+    size_t offset = sizeof(checkpointFileMagic);
+    std::string fileCiphertext;
+    uint8_t fileMode = 0;
+    uint32_t fileShardCount = 0;
+    if (!readCheckpointString(data, offset, fileCiphertext) || !readCheckpointValue(data, offset, fileMode)
+        || !readCheckpointValue(data, offset, fileShardCount))
+    {
+        return fail(fileName + " is truncated");
+    }
+    if (fileCiphertext != ciphertext || fileMode != static_cast<uint8_t>(mode) || fileShardCount != shardCount)
+    {
+        return fail(fileName + " is the checkpoint of another cryptogram, mode or number of shards");
+    }
+
+    SearchPass newPass;
+    uint8_t newHasNextPass = 0;
+    SearchPass newNextPass;
+    if (!readCheckpointPass(data, offset, newPass) || !readCheckpointValue(data, offset, newHasNextPass)
+        || (newHasNextPass && !readCheckpointPass(data, offset, newNextPass)))
+    {
+        return fail(fileName + " is truncated");
+    }
+
+    std::vector<bool> newShards(shardCount, false);
+    std::map<std::string, RankedKey> newKeys;
+    uint32_t numShards = 0;
+    uint64_t newSolutions = 0;
+    uint8_t newTruncated = 0;
+    uint32_t numKeys = 0;
+    if (!readCheckpointValue(data, offset, numShards))
+    {
+        return fail(fileName + " is truncated");
+    }
+    for(uint32_t index = 0; index < numShards; ++index)
+    {
+        uint32_t shard = 0;
+        if (!readCheckpointValue(data, offset, shard) || shard >= shardCount)
+        {
+            return fail(fileName + " is truncated");
+        }
+        newShards[shard] = true;
+    }
+    if (!readCheckpointValue(data, offset, newSolutions) || !readCheckpointValue(data, offset, newTruncated)
+        || !readCheckpointValue(data, offset, numKeys))
+    {
+        return fail(fileName + " is truncated");
+    }
+    for(uint32_t index = 0; index < numKeys; ++index)
+    {
+        RankedKey key;
+        if (!readCheckpointValue(data, offset, key.quality) || !readCheckpointString(data, offset, key.key)
+            || !readCheckpointString(data, offset, key.plaintext))
+        {
+            return fail(fileName + " is truncated");
+        }
+        newKeys[key.key] = key;
+    }
+
+    uint8_t newHasClimb = 0;
+    ClimbProgress newClimb;
+    if (!readCheckpointValue(data, offset, newHasClimb))
+    {
+        return fail(fileName + " is truncated");
+    }
+    if (newHasClimb)
+    {
+        uint32_t rootIndex = 0;
+        uint32_t poolSize = 0;
+        if (!readCheckpointValue(data, offset, rootIndex) || !readCheckpointString(data, offset, newClimb.rngState)
+            || !readCheckpointValue(data, offset, poolSize))
+        {
+            return fail(fileName + " is truncated");
+        }
+        newClimb.rootIndex = rootIndex;
+        for(uint32_t index = 0; index < poolSize; ++index)
+        {
+            double quality = 0.0;
+            uint32_t mutations = 0;
+            std::string key;
+            if (!readCheckpointValue(data, offset, quality) || !readCheckpointValue(data, offset, mutations)
+                || !readCheckpointString(data, offset, key) || key.size() != ALPHABET_LETTERS_NUM)
+            {
+                return fail(fileName + " is truncated");
+            }
+            newClimb.pool.emplace_back(quality, CryptoKeyData(CryptoKey(key.c_str(), key.size()), mutations));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pass = std::move(newPass);
+    hasNextPass = newHasNextPass != 0;
+    nextPass = std::move(newNextPass);
+    finishedShards = std::move(newShards);
+    keys = std::move(newKeys);
+    solutions = newSolutions;
+    truncated = newTruncated != 0;
+    hasClimb = newHasClimb != 0;
+    climb = std::move(newClimb);
+    return true;
+}
+
+bool CheckpointStore::save(std::string* outError) const
+{
+    if (fileName.empty())
+    {
+        return true;
+    }
+    const std::string tempFileName = fileName + ".tmp";
+    std::ofstream stream(tempFileName, std::ios::binary | std::ios::trunc);
+    if (stream.is_open())
+    {
+        stream.write(checkpointFileMagic, sizeof(checkpointFileMagic));
+        writeCheckpointString(stream, ciphertext);
+        writeCheckpointValue(stream, static_cast<uint8_t>(mode));
+        writeCheckpointValue(stream, static_cast<uint32_t>(shardCount));
+        std::lock_guard<std::mutex> lock(mutex);
+        writeCheckpointPass(stream, pass);
+        writeCheckpointValue(stream, static_cast<uint8_t>(hasNextPass ? 1 : 0));
+        if (hasNextPass)
+        {
+            writeCheckpointPass(stream, nextPass);
+        }
+        writeCheckpointValue(stream, static_cast<uint32_t>(std::count(finishedShards.begin(), finishedShards.end(), true)));
+        for(size_t shard = 0; shard < finishedShards.size(); ++shard)
+        {
+            if (finishedShards[shard])
+            {
+                writeCheckpointValue(stream, static_cast<uint32_t>(shard));
+            }
+        }
+        writeCheckpointValue(stream, static_cast<uint64_t>(solutions));
+        writeCheckpointValue(stream, static_cast<uint8_t>(truncated ? 1 : 0));
+        writeCheckpointValue(stream, static_cast<uint32_t>(keys.size()));
+        for(const auto& key : keys)
+        {
+            writeCheckpointValue(stream, key.second.quality);
+            writeCheckpointString(stream, key.second.key);
+            writeCheckpointString(stream, key.second.plaintext);
+        }
+        writeCheckpointValue(stream, static_cast<uint8_t>(hasClimb ? 1 : 0));
+        if (hasClimb)
+        {
+            writeCheckpointValue(stream, static_cast<uint32_t>(climb.rootIndex));
+            writeCheckpointString(stream, climb.rngState);
+            writeCheckpointValue(stream, static_cast<uint32_t>(climb.pool.size()));
+            for(const std::pair<double, CryptoKeyData>& entry : climb.pool)
+            {
+                writeCheckpointValue(stream, entry.first);
+                writeCheckpointValue(stream, static_cast<uint32_t>(entry.second.second));
+                writeCheckpointString(stream, std::string(entry.second.first.c_str(), entry.second.first.size()));
+            }
+        }
+    }
+    stream.close();
+    if (!stream || std::rename(tempFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::remove(tempFileName.c_str());
+        if (outError)
+        {
+            *outError = "error writing checkpoint " + fileName;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointStore::isShardDone(size_t shardIndex) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return shardIndex < finishedShards.size() && finishedShards[shardIndex];
+}
+
+size_t CheckpointStore::doneShards() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::count(finishedShards.begin(), finishedShards.end(), true);
+}
+
+bool CheckpointStore::completeShard(size_t shardIndex, const std::vector<RankedKey>& shardKeys, size_t shardSolutions, bool shardTruncated,
+                                    std::string* outError)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (shardIndex >= finishedShards.size() || finishedShards[shardIndex])
+        {
+            return true;
+        }
+        finishedShards[shardIndex] = true;
+        solutions += shardSolutions;
+        truncated = truncated || shardTruncated;
+        for(const RankedKey& key : shardKeys)
+        {
+            keys[key.key] = key;
+        }
+    }
+    return save(outError);
+}
+
+std::vector<RankedKey> CheckpointStore::shardKeys() const
+{
+    std::vector<RankedKey> retVal;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const auto& key : keys)
+        {
+            retVal.emplace_back(key.second);
+        }
+    }
+    std::stable_sort(retVal.begin(), retVal.end(), [](const RankedKey& key1, const RankedKey& key2) -> bool
+    {
+        return key1.quality > key2.quality;
+    });
+    return retVal;
+}
+
+size_t CheckpointStore::shardSolutions() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return solutions;
+}
+
+bool CheckpointStore::isTruncated() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return truncated;
+}
+
+SearchPass CheckpointStore::getPass() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pass;
+}
+
+void CheckpointStore::setNextPass(const SearchPass& newNextPass)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    hasNextPass = true;
+    nextPass = newNextPass;
+}
+
+bool CheckpointStore::getNextPass(SearchPass& outPass) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hasNextPass)
+    {
+        outPass = nextPass;
+    }
+    return hasNextPass;
+}
+
+bool CheckpointStore::startPass(const SearchPass& newPass, std::string* outError)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pass = newPass;
+        hasNextPass = false;
+        nextPass = SearchPass();
+        finishedShards.assign(shardCount, false);
+        keys.clear();
+        solutions = 0;
+    }
+    return save(outError);
+}
+
+bool CheckpointStore::getClimb(ClimbProgress& outProgress) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hasClimb)
+    {
+        outProgress = climb;
+    }
+    return hasClimb;
+}
+
+bool CheckpointStore::isSaveDue() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - lastSave).count() / 1000.0 >= saveIntervalMs;
+}
+
+void CheckpointStore::updateClimb(const ClimbProgress& progress)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hasClimb = true;
+        climb = progress;
+        lastSave = std::chrono::steady_clock::now();
+    }
+    save(nullptr);
+}
+
+SolveCheckpoint::SolveCheckpoint(const std::string& fileName, const std::string& ciphertext, SolverMode mode, size_t shardCount,
+                                 double saveIntervalMs)
+    : store(new CheckpointStore(fileName, ciphertext, mode, shardCount, saveIntervalMs))
+{
+}
+
+SolveCheckpoint::~SolveCheckpoint()
+{
+}
+
+bool SolveCheckpoint::resume(std::string* outError)
+{
+    return store->load(outError);
+}
+
+bool SolveCheckpoint::save(std::string* outError) const
+{
+    return store->save(outError);
+}
+
+bool SolveCheckpoint::isShardDone(size_t shardIndex) const
+{
+    return store->isShardDone(shardIndex);
+}
+
+size_t SolveCheckpoint::doneShards() const
+{
+    return store->doneShards();
+}
+
+bool SolveCheckpoint::completeShard(size_t shardIndex, const std::vector<RankedKey>& keys, size_t solutions, bool truncated,
+                                    std::string* outError)
+{
+    return store->completeShard(shardIndex, keys, solutions, truncated, outError);
+}
+
+std::vector<RankedKey> SolveCheckpoint::shardKeys() const
+{
+    return store->shardKeys();
+}
+
+size_t SolveCheckpoint::shardSolutions() const
+{
+    return store->shardSolutions();
+}
+
+bool SolveCheckpoint::isTruncated() const
+{
+    return store->isTruncated();
+}
+
+SearchPass SolveCheckpoint::pass() const
+{
+    return store->getPass();
+}
+
+void SolveCheckpoint::setNextPass(const SearchPass& nextPass)
+{
+    store->setNextPass(nextPass);
+}
+
+bool SolveCheckpoint::getNextPass(SearchPass& outPass) const
+{
+    return store->getNextPass(outPass);
+}
+
+bool SolveCheckpoint::startPass(const SearchPass& pass, std::string* outError)
+{
+    return store->startPass(pass, outError);
+}
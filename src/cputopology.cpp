@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cstdlib>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+#include "fastcryptosolver.h"
+
+size_t CpuTopology::cpuCount() const
+{
+    size_t retVal = 0;
+    for(const std::vector<int>& cpus : nodeCpus)
+    {
+        retVal += cpus.size();
+    }
+    return retVal;
+}
+
+// The CPUs of a sysfs list like "0-3,8,10-11"
+std::vector<int> parseCpuList(const std::string& text)
+{
+    std::vector<int> retVal;
+    std::istringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        char* end = nullptr;
+        const long first = std::strtol(range.c_str(), &end, 10);
+        if (end == range.c_str())
+        {
+            continue;
+        }
+        const long last = *end == '-' ? std::strtol(end + 1, nullptr, 10) : first;
+        for(long cpu = first; cpu <= last; ++cpu)
+        {
+            retVal.push_back(static_cast<int>(cpu));
+        }
+    }
+    return retVal;
+}
+
+#ifdef HAVE_LIBNUMA
+std::vector<std::vector<int>> readNumaNodes()
+{
+    std::vector<std::vector<int>> retVal;
+    if (numa_available() < 0)
+    {
+        return retVal;
+    }
+    struct bitmask* mask = numa_allocate_cpumask();
+    const int numCpus = numa_num_configured_cpus();
+    for(int node = 0; node <= numa_max_node(); ++node)
+    {
+        retVal.emplace_back();
+        if (numa_node_to_cpus(node, mask) != 0)
+        {
+            continue;
+        }
+        for(int cpu = 0; cpu < numCpus; ++cpu)
+        {
+            if (numa_bitmask_isbitset(mask, cpu))
+            {
+                retVal.back().push_back(cpu);
+            }
+        }
+    }
+    numa_free_cpumask(mask);
+    return retVal;
+}
+#else
+std::vector<std::vector<int>> readNumaNodes()
+{
+    std::vector<std::vector<int>> retVal;
+    DIR* directory = opendir("/sys/devices/system/node");
+    if (!directory)
+    {
+        return retVal;
+    }
+    std::vector<int> nodes;
+    while (const dirent* entry = readdir(directory))
+    {
+        char* end = nullptr;
+        if (strncmp(entry->d_name, "node", 4) == 0)
+        {
+            const long node = std::strtol(entry->d_name + 4, &end, 10);
+            if (end != entry->d_name + 4 && *end == 0)
+            {
+                nodes.push_back(static_cast<int>(node));
+            }
+        }
+    }
+    closedir(directory);
+    std::sort(nodes.begin(), nodes.end());
+    for(const int node : nodes)
+    {
+        std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string text;
+        std::getline(cpuList, text);
+        retVal.push_back(parseCpuList(text));
+    }
+    return retVal;
+}
+#endif
+
+CpuTopology getCpuTopology()
+{
+    CpuTopology retVal;
+    std::vector<int> allowedCpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                allowedCpus.push_back(cpu);
+            }
+        }
+    }
+    else
+    {
+        for(unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+        {
+            allowedCpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    for(const std::vector<int>& nodeCpus : readNumaNodes())
+    {
+        // memory-only nodes and CPUs outside the affinity mask of the process are dropped
+        std::vector<int> cpus;
+        for(const int cpu : nodeCpus)
+        {
+            if (std::find(allowedCpus.begin(), allowedCpus.end(), cpu) != allowedCpus.end())
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty())
+        {
+            retVal.nodeCpus.emplace_back(std::move(cpus));
+        }
+    }
+    if (retVal.nodeCpus.empty())
+    {
+        retVal.nodeCpus.emplace_back(std::move(allowedCpus));
+    }
+    return retVal;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus)
+{
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for(const int cpu : cpus)
+    {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &cpuSet);
+        }
+    }
+    return CPU_COUNT(&cpuSet) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
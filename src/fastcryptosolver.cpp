@@ -1,896 +1,2110 @@
 #include <iostream>
 #include <fstream>
-#include <array>
 #include <vector>
 #include <string>
-#include <unordered_set>
-#include <set>
-#include <unordered_map>
+#include <map>
 #include <chrono>
 #include <iomanip>
 #include <algorithm>
 #include <thread>
-#include <map>
-#include <future>
-#include <random>
 #include <sstream>
 #include <string.h>
-#include <future>
-#include <assert.h>
-#include "MurmurHash3.h"
-#include "boost/multi_array.hpp"
-
+#include <cstdlib>
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "fastcryptosolver.h"
 
 constexpr const char* wordlistName = "../wordlist/google-10000-english-usa.txt";
-constexpr unsigned int ALPHABET_LETTERS_NUM = 26;
-constexpr unsigned int GOOD_SOLUTION_NUM = 1000;
-constexpr double SOLUTION_QUALITY = 0.7;
-constexpr unsigned int maxTextLength = 70;
-constexpr int mutateGoodLetterFactor = 20;
-constexpr size_t maxWords = 20;
-constexpr unsigned int keyTryLimit = 80000000u;
+constexpr const char* largeWordlistName = "../wordlist/english_small.txt";
 
-#define NAIVE_COMBINATON 1
+void printSolution(const RankedKey& key)
+{
+    std::cout << "Key: " << key.key << " Q(" << std::setprecision(4) << std::fixed << key.quality
+        << ") Decrypted: " << key.plaintext << std::endl;
+}
 
-std::random_device rd;
-std::default_random_engine e1(rd());
+// Everything the command line selects, the solver part is passed on to the library
+struct CommandLineOptions
+{
+    SolverOptions solver;
+    std::vector<std::string> wordlists;
+    std::string batchInput;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool pin = false;                   // every worker on its own CPU
+    bool numa = false;                  // a dictionary replica per NUMA node, implies pin
+    std::string serveSocket;
+    size_t deadlineMs = 0;
+    std::string coordinateAddress;      // host:port or a Unix socket path
+    size_t shards = 16;
+    size_t localWorkers = 0;
+    std::string workerAddress;
+    std::string checkpointFile;
+    size_t checkpointIntervalMs = 5000;
+    bool resume = false;
+    std::string candidateCacheFile;
+    size_t candidateCacheMB = 0;        // 0 for the default, batch and server mode always cache
+    std::string metricsFile;
+    bool quiet = false;
+    LogLevel logLevel = LogLevel::Info;
+    std::string cryptogram = "TUQS MGZI BHDDWA MGZSP ZI GUVT";
+};
 
-template<int maxLen>
-class FixedString
+// The modes that climb over full keys, their shards are independent climbs
+bool isClimbMode(SolverMode mode)
 {
-    static constexpr int arrSize = maxLen + 1;
-public:
-    FixedString() : currentLen(0)
+    return mode == SolverMode::Climb || mode == SolverMode::Patristocrat;
+}
+
+void printUsage(const char* programName)
+{
+    const SolverOptions defaults;
+    std::cout << "Usage: " << programName << " [options]" << std::endl
+        << "  --text CRYPTOGRAM       cryptogram to solve" << std::endl
+        << "  --mode MODE             exhaustive (default), beam, best-first, climb or patristocrat (no word breaks)" << std::endl
+        << "  --beam-width B          partial keys kept after each join in beam mode (default " << defaults.beamWidth << ")" << std::endl
+        << "  --max-solutions N       best keys reported (default " << defaults.maxSolutions << ")" << std::endl
+        << "  --max-unknown-words K   words that may be left out of the dictionary match (default 0)" << std::endl
+        << "  --max-memory MB         hard limit for the key lists (default " << defaults.memoryLimitMB << ")" << std::endl
+        << "  --batch FILE            solve every line of FILE (- for stdin), one JSON result per line" << std::endl
+        << "  --threads N             worker threads in batch and server mode (default: all cores)" << std::endl
+        << "  --pin                   pin every worker thread to one CPU, spread over the NUMA nodes" << std::endl
+        << "  --numa                  pin and give the workers of each NUMA node their own dictionary copy" << std::endl
+        << "  --serve SOCKET          serve solve requests on a Unix domain socket" << std::endl
+        << "  --time-limit-ms MS      wall-clock limit of one solve, the best key so far is reported" << std::endl
+        << "  --deadline-ms MS        default per-request deadline in server mode (default none)" << std::endl
+        << "  --coordinate ADDRESS    hand out shards of the solve to worker processes on host:port or a socket path" << std::endl
+        << "  --shards N              shards of a coordinated solve (default 16)" << std::endl
+        << "  --local-workers N       worker processes the coordinator starts on this machine (default 0)" << std::endl
+        << "  --worker ADDRESS        solve shards for the coordinator at ADDRESS" << std::endl
+        << "  --checkpoint FILE       save the progress to FILE, exhaustive mode runs as --shards shards" << std::endl
+        << "  --checkpoint-interval-ms MS  time between two checkpoints of a climb (default 5000)" << std::endl
+        << "  --resume                go on from the --checkpoint FILE of an earlier run" << std::endl
+        << "  --known Q=T,W=H         known cipher=plain letters, or a whole key with '*' for unknown letters" << std::endl
+        << "  --crib WORDS[@N]        known plaintext words, at word number N (from 1) or anywhere" << std::endl
+        << "  --candidate-cache FILE  keep the word candidates in FILE between runs" << std::endl
+        << "  --candidate-cache-mb MB memory for the word candidates kept between solves (default 256)" << std::endl
+        << "  --climb-mutation M      frequency (default) or uniform choice of the new plain letter in climb mode" << std::endl
+        << "  --climb-acceptance A    walk (default) goes on from every mutated key, plateau only from keys not worse" << std::endl
+        << "  --seen-key-filter-kb KB memory of the climber's filter of keys walked on, 0 for none (default " << defaults.seenKeyFilterKB << ")" << std::endl
+        << "  --metrics FILE          write the phase timings and search counters as JSON at exit, not with --coordinate" << std::endl
+        << "  --quiet                 no progress output of the solver" << std::endl
+        << "  --verbose               also log every key the climber keeps or drops" << std::endl
+        << "  --wordlist FILE         dictionary tier, repeat from the smallest to the largest" << std::endl
+        << "                          (default " << wordlistName << " and " << largeWordlistName << ")" << std::endl;
+}
+
+bool parseSizeArgument(const char* text, size_t& outValue)
+{
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (end == text || *end != 0 || value == 0)
     {
-        memset(array, 0, arrSize);
+        return false;
     }
+    outValue = static_cast<size_t>(value);
+    return true;
+}
 
-    FixedString(const std::string& original) : currentLen(original.size())
+// Either a key like the ones printed, with '*' for the unknown letters, or cipher=plain
+// pairs separated by commas
+bool parseKnownLetters(const std::string& text, std::string& outKey)
+{
+    if (text.find('=') == std::string::npos)
     {
-        memset(array, 0, arrSize);
-        memcpy(array, original.c_str(), original.size());
+        outKey = text;
+        return true;
     }
+    outKey.assign(26, '*');
+    std::istringstream pairs(text);
+    std::string pair;
+    while (std::getline(pairs, pair, ','))
+    {
+        if (pair.size() != 3 || pair[1] != '=' || !isalpha(static_cast<unsigned char>(pair[0])) || !isalpha(static_cast<unsigned char>(pair[2])))
+        {
+            return false;
+        }
+        outKey[toupper(pair[0]) - 'A'] = static_cast<char>(toupper(pair[2]));
+    }
+    return true;
+}
 
-    FixedString(const char * cStr)
+bool parseCommandLine(int argc, char* argv[], CommandLineOptions& options)
+{
+    for(int index = 1; index < argc; ++index)
     {
-        memset(array, 0, arrSize);
-        if(cStr)
+        const std::string argument = argv[index];
+        const bool hasValue = index + 1 < argc;
+        if (argument == "--text" && hasValue)
+        {
+            options.cryptogram = argv[++index];
+            std::transform(options.cryptogram.begin(), options.cryptogram.end(), options.cryptogram.begin(), ::toupper);
+        }
+        else if (argument == "--mode" && hasValue)
+        {
+            const std::string mode = argv[++index];
+            if (mode == "exhaustive")
+            {
+                options.solver.mode = SolverMode::Exhaustive;
+            }
+            else if (mode == "beam")
+            {
+                options.solver.mode = SolverMode::Beam;
+            }
+            else if (mode == "best-first")
+            {
+                options.solver.mode = SolverMode::BestFirst;
+            }
+            else if (mode == "climb")
+            {
+                options.solver.mode = SolverMode::Climb;
+            }
+            else if (mode == "patristocrat")
+            {
+                options.solver.mode = SolverMode::Patristocrat;
+            }
+            else
+            {
+                std::cout << "Unknown mode: " << mode << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--beam-width" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.solver.beamWidth))
+            {
+                std::cout << "Invalid beam width: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--max-solutions" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.solver.maxSolutions))
+            {
+                std::cout << "Invalid number of solutions: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--max-unknown-words" && hasValue)
+        {
+            char* end = nullptr;
+            options.solver.maxUnknownWords = std::strtoul(argv[++index], &end, 10);
+            if (end == argv[index] || *end != 0)
+            {
+                std::cout << "Invalid number of unknown words: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--batch" && hasValue)
+        {
+            options.batchInput = argv[++index];
+        }
+        else if (argument == "--threads" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.threads))
+            {
+                std::cout << "Invalid number of threads: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--coordinate" && hasValue)
+        {
+            options.coordinateAddress = argv[++index];
+        }
+        else if (argument == "--shards" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.shards))
+            {
+                std::cout << "Invalid number of shards: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--local-workers" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.localWorkers))
+            {
+                std::cout << "Invalid number of local workers: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--worker" && hasValue)
+        {
+            options.workerAddress = argv[++index];
+        }
+        else if (argument == "--checkpoint" && hasValue)
+        {
+            options.checkpointFile = argv[++index];
+        }
+        else if (argument == "--checkpoint-interval-ms" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.checkpointIntervalMs))
+            {
+                std::cout << "Invalid checkpoint interval: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--resume")
+        {
+            options.resume = true;
+        }
+        else if (argument == "--pin")
+        {
+            options.pin = true;
+        }
+        else if (argument == "--numa")
+        {
+            options.pin = true;
+            options.numa = true;
+        }
+        else if (argument == "--serve" && hasValue)
+        {
+            options.serveSocket = argv[++index];
+        }
+        else if (argument == "--time-limit-ms" && hasValue)
+        {
+            size_t timeLimitMs = 0;
+            if (!parseSizeArgument(argv[++index], timeLimitMs))
+            {
+                std::cout << "Invalid time limit: " << argv[index] << std::endl;
+                return false;
+            }
+            options.solver.timeLimitMs = static_cast<double>(timeLimitMs);
+        }
+        else if (argument == "--deadline-ms" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.deadlineMs))
+            {
+                std::cout << "Invalid deadline: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--known" && hasValue)
+        {
+            if (!parseKnownLetters(argv[++index], options.solver.knownKey))
+            {
+                std::cout << "Invalid known letters: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--crib" && hasValue)
+        {
+            Crib crib;
+            crib.plaintext = argv[++index];
+            const size_t separator = crib.plaintext.rfind('@');
+            if (separator != std::string::npos)
+            {
+                size_t wordNumber = 0;
+                if (!parseSizeArgument(crib.plaintext.c_str() + separator + 1, wordNumber))
+                {
+                    std::cout << "Invalid crib position: " << argv[index] << std::endl;
+                    return false;
+                }
+                crib.plaintext.erase(separator);
+                crib.wordIndex = static_cast<int>(wordNumber - 1);
+            }
+            options.solver.cribs.emplace_back(crib);
+        }
+        else if (argument == "--candidate-cache" && hasValue)
+        {
+            options.candidateCacheFile = argv[++index];
+        }
+        else if (argument == "--candidate-cache-mb" && hasValue)
+        {
+            if (!parseSizeArgument(argv[++index], options.candidateCacheMB))
+            {
+                std::cout << "Invalid candidate cache size: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--quiet")
+        {
+            options.quiet = true;
+        }
+        else if (argument == "--verbose")
+        {
+            options.logLevel = LogLevel::Debug;
+        }
+        else if (argument == "--climb-mutation" && hasValue)
+        {
+            const std::string mutation = argv[++index];
+            if (mutation == "frequency")
+            {
+                options.solver.climbMutation = ClimbMutation::Frequency;
+            }
+            else if (mutation == "uniform")
+            {
+                options.solver.climbMutation = ClimbMutation::Uniform;
+            }
+            else
+            {
+                std::cout << "Unknown climb mutation: " << mutation << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--climb-acceptance" && hasValue)
+        {
+            const std::string acceptance = argv[++index];
+            if (acceptance == "walk")
+            {
+                options.solver.climbAcceptance = ClimbAcceptance::RandomWalk;
+            }
+            else if (acceptance == "plateau")
+            {
+                options.solver.climbAcceptance = ClimbAcceptance::Plateau;
+            }
+            else
+            {
+                std::cout << "Unknown climb acceptance: " << acceptance << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--seen-key-filter-kb" && hasValue)
+        {
+            // 0 turns the filter off
+            const char* value = argv[++index];
+            if (strcmp(value, "0") == 0)
+            {
+                options.solver.seenKeyFilterKB = 0;
+            }
+            else if (!parseSizeArgument(value, options.solver.seenKeyFilterKB))
+            {
+                std::cout << "Invalid seen key filter size: " << argv[index] << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--metrics" && hasValue)
+        {
+            options.metricsFile = argv[++index];
+        }
+        else if (argument == "--wordlist" && hasValue)
+        {
+            options.wordlists.emplace_back(argv[++index]);
+        }
+        else if (argument == "--max-memory" && hasValue)
         {
-            currentLen = strnlen(cStr, maxLen);
-            memcpy(array, cStr, currentLen);
+            if (!parseSizeArgument(argv[++index], options.solver.memoryLimitMB))
+            {
+                std::cout << "Invalid memory limit: " << argv[index] << std::endl;
+                return false;
+            }
         }
         else
         {
-            currentLen = 0;
+            std::cout << "Unknown or incomplete argument: " << argument << std::endl;
+            return false;
         }
     }
-    ~FixedString(){}
-
-    inline const char * c_str() const
+    if (options.wordlists.empty())
     {
-        return array;
+        options.wordlists.emplace_back(wordlistName);
+        options.wordlists.emplace_back(largeWordlistName);
     }
-
-    inline const char& at(size_t offset) const
+    if (options.resume && options.checkpointFile.empty())
     {
-        assert(offset >= 0);
-        assert(offset < maxLen);
-        return array[offset];
+        std::cout << "--resume needs the --checkpoint file" << std::endl;
+        return false;
     }
-
-    inline char& at(size_t offset)
+    if (!options.metricsFile.empty() && !options.coordinateAddress.empty())
     {
-        return array[offset];
+        // the searches run in the worker processes, the coordinator has no metrics to write
+        std::cout << "--metrics is not available with --coordinate" << std::endl;
+        return false;
     }
-
-    inline size_t size() const
+    if (!options.coordinateAddress.empty() && (options.solver.mode == SolverMode::Beam || options.solver.mode == SolverMode::BestFirst))
     {
-        return currentLen;
+        // every shard would keep its own beam or stop after its own best keys
+        std::cout << "--coordinate only shards the exhaustive and climb modes" << std::endl;
+        return false;
     }
+    return true;
+}
 
-    struct hasher
+
+// Fixed set of worker threads taking tasks from one queue in FIFO order. With cpus the
+// worker with index i only runs on cpus[i].
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t numThreads, const std::vector<int>& cpus = std::vector<int>()) : cpus(cpus)
     {
-        size_t operator()( const FixedString<maxLen>& objToHash ) const
+        for(size_t index = 0; index < numThreads; ++index)
         {
-            size_t retVal;
-            MurmurHash3_x86_32(&objToHash.array, sizeof(FixedString<maxLen>::array), 0xDEADBEEF, &retVal);
-            return retVal;
+            workers.emplace_back(&ThreadPool::workerLoop, this, index);
         }
-    };
-
-    inline bool operator==(const FixedString<maxLen>& other) const
-    {
-        return (memcmp(array, other.array, currentLen) == 0);
     }
 
-    inline void operator=(const FixedString<maxLen> &other )
+    ~ThreadPool()
     {
-        memcpy(array, other.array, arrSize);
-        currentLen = other.currentLen;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskAvailable.notify_all();
+        for(std::thread& worker : workers)
+        {
+            worker.join();
+        }
     }
 
-    inline size_t find_first_of(const char val, size_t offset = 0) const
+    void enqueue(std::function<void()> task)
     {
-        size_t retVal = npos;
-        if(offset <= currentLen)
         {
-            for(size_t index = offset; index < currentLen; ++index)
-            {
-                if(val == array[index])
-                {
-                    retVal = index;
-                    break;
-                }
-            }
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back(std::move(task));
         }
-        return retVal;
+        taskAvailable.notify_one();
     }
 
-    inline void push_back(char chr)
+    // blocks until the queue is empty and no task is running
+    void wait()
     {
-        array[currentLen] = chr;
-        currentLen++;
+        std::unique_lock<std::mutex> lock(mutex);
+        allDone.wait(lock, [this]() { return tasks.empty() && activeTasks == 0; });
     }
 
-    inline FixedString<maxLen> substr(size_t begin, size_t len) const
+    size_t size() const
     {
-        FixedString<maxLen> retVal;
-        assert(begin + len < arrSize);
-        memset(retVal.array, 0, arrSize);
-        memcpy(retVal.array, &array[begin], len);
-        retVal.currentLen = len;
-        return retVal;
+        return workers.size();
     }
 
-    inline size_t count(const char val) 
+    // index of the worker running the calling task
+    static size_t workerIndex()
+    {
+        return currentWorker;
+    }
+
+private:
+    void workerLoop(size_t index)
     {
-        size_t retVal = 0;
-        for (size_t index = 0; index < currentLen; ++index) 
+        currentWorker = index;
+        if (index < cpus.size() && !pinCurrentThread(std::vector<int>(1, cpus[index])))
         {
-            if (array[index] == val) 
+            std::cerr << "Could not pin worker " << index << " to CPU " << cpus[index] << std::endl;
+        }
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                ++activeTasks;
+            }
+            task();
             {
-                ++retVal;
+                std::lock_guard<std::mutex> lock(mutex);
+                --activeTasks;
+                if (tasks.empty() && activeTasks == 0)
+                {
+                    allDone.notify_all();
+                }
             }
         }
-        return retVal;
     }
 
-    static const size_t npos = static_cast<size_t>(-1);
+    static thread_local size_t currentWorker;
 
-private:
-    size_t currentLen;
-    alignas(16) char array[arrSize];
+    std::vector<int> cpus;
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable allDone;
+    size_t activeTasks = 0;
+    bool stopping = false;
 };
 
+thread_local size_t ThreadPool::currentWorker = 0;
 
+// The solver of every NUMA node with --numa, otherwise a single one for all workers
+using NodeSolvers = std::vector<std::shared_ptr<const Solver>>;
+
+// Where the workers of a pool run. Consecutive workers go to different nodes, so a pool
+// smaller than the machine still uses the memory bandwidth of every socket.
+struct WorkerPlacement
+{
+    std::vector<int> cpus;          // empty when the workers are not pinned
+    std::vector<size_t> nodes;      // the node solver of every worker, empty for one solver
 
-//using Word = std::string;
-//using WordList = std::unordered_set<std::string>;
-using Word = FixedString<maxTextLength>;
-using WordList = std::unordered_set<Word, Word::hasher>;
-using WordPatternMap = std::unordered_map<Word, WordList, Word::hasher>;
-using WordArray = std::array<Word, maxWords>;
-using CryptoText = FixedString<maxTextLength>;
-using CryptoKey = FixedString<ALPHABET_LETTERS_NUM>;
-using CryptoKeyList = std::vector<CryptoKey>;
-using CryptoKeySet = std::unordered_set<CryptoKey, CryptoKey::hasher>;
-using CryptoKeyData = std::pair<CryptoKey, unsigned int>;
-using Solution = std::pair<CryptoKeyData, const CryptoText>;
-using SolutionMap = std::multimap<double, Solution>;
-using LetterFrequencyMap = std::map<char, unsigned int>;
-using Combination = std::vector<int>;
-using CombinationList = std::vector<Combination>;
-using Matrix2D = boost::multi_array<int, 2>;
+    const Solver& solver(const NodeSolvers& solvers, size_t worker) const
+    {
+        return *solvers[nodes.empty() ? 0 : nodes[worker]];
+    }
+};
 
-Word getWordPattern(const Word& word)
+WorkerPlacement placeWorkers(const CommandLineOptions& options, const CpuTopology& topology, size_t numWorkers)
 {
+    WorkerPlacement retVal;
+    if (!options.pin)
+    {
+        return retVal;
+    }
+    std::vector<size_t> nextCpu(topology.nodeCpus.size(), 0);
+    for(size_t worker = 0; worker < numWorkers; ++worker)
+    {
+        // more workers than CPUs share them round robin
+        const size_t node = worker % topology.nodeCpus.size();
+        const std::vector<int>& cpus = topology.nodeCpus[node];
+        retVal.cpus.push_back(cpus[nextCpu[node]++ % cpus.size()]);
+        if (options.numa)
+        {
+            retVal.nodes.push_back(node);
+        }
+    }
+    return retVal;
+}
 
-    Word retVal;
-    Word listOfUsedLetters;
-    char code = 'A';
-    for(size_t index = 0; index < word.size(); ++index)
+// All dictionary tiers are preloaded. With --numa every node gets its own copy, loaded by
+// a thread restricted to the CPUs of the node: the first touch puts the pages of the
+// copy in the memory of that node, so its workers score against local memory only.
+std::shared_ptr<const NodeSolvers> loadNodeSolvers(const CommandLineOptions& options, const CpuTopology& topology)
+{
+    const size_t numSolvers = options.numa ? topology.nodeCpus.size() : 1;
+    std::shared_ptr<NodeSolvers> retVal = std::make_shared<NodeSolvers>(numSolvers);
+    std::vector<std::string> errors(numSolvers);
+    auto loadSolver = [&](size_t node)
     {
-        const char& chr = word.at(index);
-        size_t pos = listOfUsedLetters.find_first_of(chr);
-        if(pos == Word::npos)
+        if (options.numa && !pinCurrentThread(topology.nodeCpus[node]))
         {
-            retVal.push_back(code);
-            listOfUsedLetters.push_back(chr);
-            code++;
+            std::cerr << "Could not move the dictionary loader to NUMA node " << node << std::endl;
         }
-        else
+        std::shared_ptr<const DictionaryContext> dictionary = DictionaryContext::load(options.wordlists, true, &errors[node]);
+        if (dictionary)
+        {
+            (*retVal)[node] = std::make_shared<const Solver>(dictionary);
+        }
+    };
+    if (!options.numa)
+    {
+        loadSolver(0);
+    }
+    else
+    {
+        std::vector<std::thread> loaders;
+        for(size_t node = 0; node < numSolvers; ++node)
+        {
+            loaders.emplace_back(loadSolver, node);
+        }
+        for(std::thread& loader : loaders)
+        {
+            loader.join();
+        }
+    }
+    for(size_t node = 0; node < numSolvers; ++node)
+    {
+        if (!(*retVal)[node])
         {
-            retVal.push_back(retVal.at(pos));
+            std::cerr << "Error loading the wordlists: " << errors[node] << std::endl;
+            return nullptr;
         }
     }
     return retVal;
 }
 
-WordPatternMap createPatternMap(WordList& list)
+std::string escapeJson(const std::string& text)
 {
-    WordPatternMap retVal;
-    for(const Word& word : list)
+    std::string retVal;
+    retVal.reserve(text.size());
+    for(const char chr : text)
     {
-        Word pattern = getWordPattern(word);
-        WordList& wordListOfCurrentPattern = retVal[pattern];
-        wordListOfCurrentPattern.emplace(word);
+        switch (chr)
+        {
+        case '"':
+            retVal += "\\\"";
+            break;
+        case '\\':
+            retVal += "\\\\";
+            break;
+        case '\n':
+            retVal += "\\n";
+            break;
+        case '\t':
+            retVal += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(chr) < 0x20)
+            {
+                char buffer[8];
+                snprintf(buffer, sizeof(buffer), "\\u%04x", chr);
+                retVal += buffer;
+            }
+            else
+            {
+                retVal += chr;
+            }
+        }
     }
     return retVal;
 }
 
-CryptoKey getInitialKey()
+// "tier":T,"unknown_words":[...] of pass, as a JSON object
+std::string searchPassToJson(const SearchPass& pass)
 {
-    return CryptoKey("**************************");
+    std::string retVal = "{\"tier\":" + std::to_string(pass.tier) + ",\"unknown_words\":[";
+    for(size_t index = 0; index < pass.unknownWords.size(); ++index)
+    {
+        retVal += (index > 0 ? "," : "") + std::to_string(pass.unknownWords[index]);
+    }
+    return retVal + "]}";
 }
 
-CryptoKey getCommonKeyFromTwoWords(const Word& encryptedWord, const Word& decryptedWord)
+// Solve one cryptogram and describe the result as a single line JSON object starting with
+// idMember (for example "line":5). A shard that can be widened adds its next_pass. The best keys by quality come first, at most
+// options.maxSolutions of them.
+std::string solvePuzzleToJson(const std::string& idMember, std::string text, const Solver& solver, const SolverOptions& options, bool& outSolved,
+                              SolverMetrics& outMetrics)
 {
-    CryptoKey retVal = getInitialKey();
-    assert(encryptedWord.size() == decryptedWord.size());
-    for(size_t index = 0; index < encryptedWord.size(); ++index)
+    std::ostringstream json;
+    std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+    json << "{" << idMember << ",\"text\":\"" << escapeJson(text) << "\"";
+
+    const SolverResult result = solver.solve(text, options);
+    outSolved = result.solved();
+    outMetrics = result.metrics;
+    if (!result.error.empty())
     {
-        const char& chrEnc = encryptedWord.at(index);
-        const char& chrDec = decryptedWord.at(index);
-        retVal.at(chrEnc - 'A') = chrDec;
+        json << ",\"error\":\"" << escapeJson(result.error) << "\"}";
+        return json.str();
     }
-    return retVal;
+    json << ",\"solved\":" << (outSolved ? "true" : "false")
+        << ",\"interrupted\":" << (result.interrupted ? "true" : "false")
+        << ",\"truncated\":" << (result.truncated ? "true" : "false")
+        << ",\"solutions\":" << result.solutions
+        << ",\"solve_ms\":" << std::setprecision(3) << std::fixed << result.solveMs
+        << ",\"keys\":[";
+    for(size_t index = 0; index < result.keys.size(); ++index)
+    {
+        const RankedKey& key = result.keys[index];
+        json << (index > 0 ? "," : "") << "{\"key\":\"" << escapeJson(key.key)
+            << "\",\"plaintext\":\"" << escapeJson(key.plaintext)
+            << "\",\"quality\":" << std::setprecision(4) << key.quality << "}";
+    }
+    json << "]";
+    if (result.hasNextPass)
+    {
+        json << ",\"next_pass\":" << searchPassToJson(result.nextPass);
+    }
+    json << "}";
+    return json.str();
 }
 
-CryptoKeyList getMatchingKeys(const Word& encryptedWord, const WordList& possibleMatches)
+// The metrics of all solves and the dictionary as one JSON object. The timings of every
+// word and join are only there for a single solve.
+bool writeMetrics(const std::string& fileName, const SolverMetrics& metrics, const DictionaryContext& dictionary,
+                  const std::shared_ptr<CandidateCache>& cache)
 {
-    CryptoKeyList retVal;
-
-    for(const Word& matchingWord : possibleMatches)
+    std::ofstream file(fileName, std::ios::trunc);
+    file << std::setprecision(3) << std::fixed << "{\"solves\":" << metrics.solves << ",\"dictionary\":[";
+    const std::vector<DictionaryTierMetrics> tiers = dictionary.tierMetrics();
+    for(size_t index = 0; index < tiers.size(); ++index)
+    {
+        const DictionaryTierMetrics& tier = tiers[index];
+        file << (index > 0 ? "," : "") << "{\"file\":\"" << escapeJson(tier.fileName) << "\",\"loaded\":" << (tier.loaded ? "true" : "false")
+            << ",\"words\":" << tier.words << ",\"load_ms\":" << tier.loadMs << ",\"pattern_map_ms\":" << tier.patternMapMs << "}";
+    }
+    file << "],\"candidate_ms\":" << metrics.candidateMs << ",\"search_ms\":" << metrics.searchMs << ",\"rank_ms\":" << metrics.rankMs
+        << ",\"candidate_words\":" << metrics.candidateWords << ",\"join_steps\":" << metrics.joinSteps
+        << ",\"pruned_keys\":" << metrics.prunedKeys << ",\"scoring_calls\":" << metrics.scoringCalls
+        << ",\"mutations\":" << metrics.mutations << ",\"mutations_per_s\":" << metrics.mutationsPerSecond()
+        << ",\"seen_key_checks\":" << metrics.seenKeyChecks
+        << ",\"seen_key_hits\":" << metrics.seenKeyHits << ",\"seen_key_hit_rate\":" << metrics.seenKeyHitRate();
+    if (cache)
+    {
+        const CandidateCacheStats stats = cache->stats();
+        file << ",\"candidate_cache\":{\"hits\":" << stats.hits << ",\"misses\":" << stats.misses << ",\"patterns\":" << stats.patterns
+            << ",\"bytes\":" << stats.bytes << "}";
+    }
+    file << ",\"words\":[";
+    for(size_t index = 0; index < metrics.words.size(); ++index)
+    {
+        const SolverMetrics::WordCandidates& word = metrics.words[index];
+        file << (index > 0 ? "," : "") << "{\"word\":" << word.word << ",\"candidates\":" << word.candidates << ",\"ms\":" << word.ms << "}";
+    }
+    file << "],\"joins\":[";
+    for(size_t index = 0; index < metrics.joins.size(); ++index)
     {
-        retVal.emplace_back(getCommonKeyFromTwoWords(encryptedWord, matchingWord));
+        const SolverMetrics::JoinStep& join = metrics.joins[index];
+        file << (index > 0 ? "," : "") << "{\"word\":" << join.word << ",\"input_keys\":" << join.inputKeys << ",\"candidates\":" << join.candidates
+            << ",\"output_keys\":" << join.outputKeys << ",\"ms\":" << join.ms << "}";
     }
+    file << "]}" << std::endl;
+    if (!file)
+    {
+        std::cerr << "Error writing the metrics to " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
 
+// Memory limit of one of numWorkers solves running in parallel
+SolverOptions splitMemoryLimit(const SolverOptions& options, size_t numWorkers)
+{
+    SolverOptions retVal = options;
+    retVal.memoryLimitMB = std::max<size_t>(1, options.memoryLimitMB / numWorkers);
     return retVal;
 }
-CryptoKeyList combineTwoKeys(const CryptoKey& key1, const CryptoKey& key2, bool keepBadResults)
+
+// Solve every line of the input as a separate cryptogram. All dictionary tiers are loaded
+// up front and shared read-only by the workers, with --numa by those of one node. The
+// puzzles go to the pool from the longest to the shortest, so a big one does not end up
+// alone at the end of the run, and each result is written as soon as it is ready. The
+// memory limit is split between the workers. Throughput goes to stderr at the end.
+int runBatch(const CommandLineOptions& options, const NodeSolvers& solvers, const CpuTopology& topology)
 {
-    CryptoKeyList list;
-    CryptoKey outKey(getInitialKey());
-    bool success = true;
-    for (size_t index = 0; index < key1.size(); ++index)
+    std::ifstream inputFile;
+    if (options.batchInput != "-")
     {
-        const char& chr1 = key1.at(index);
-        const char& chr2 = key2.at(index);
-        if ((chr1 != '*') && (chr2 != '*'))
+        inputFile.open(options.batchInput);
+        if (!inputFile.is_open())
         {
-            success = false;
-            break;
+            std::cerr << "Error opening batch file " << options.batchInput << std::endl;
+            return 1;
         }
-        else if (chr1 != '*')
+    }
+    std::istream& input = options.batchInput == "-" ? std::cin : inputFile;
+
+    std::vector<std::pair<size_t, std::string>> puzzles;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(input, line))
+    {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r')
         {
-            outKey.at(index) = chr1;
+            line.pop_back();
         }
-        else if (chr2 != '*')
+        if (!line.empty())
         {
-            outKey.at(index) = chr2;
+            puzzles.emplace_back(lineNumber, line);
         }
     }
-    if (success) 
-    {
-        list.emplace_back(outKey);
-    }
-    else if(keepBadResults)
+    std::stable_sort(puzzles.begin(), puzzles.end(),
+                     [](const std::pair<size_t, std::string>& puzzle1, const std::pair<size_t, std::string>& puzzle2) -> bool
     {
-        list.emplace_back(key1);
-        list.emplace_back(key2);
-    }
-    return list;
-}
+        return puzzle1.second.size() > puzzle2.second.size();
+    });
 
-CryptoKeyList combineTwoKeyLists(const CryptoKeyList& keyList1, const CryptoKeyList& keyList2)
-{
-    CryptoKeyList retVal;
-    CryptoKeyList::const_iterator it1;
-    CryptoKeyList::const_iterator it2;
+    setSolverLog(nullptr);
 
-    for (it1 = keyList1.begin(); it1 != keyList1.end(); ++it1)
+    const size_t numThreads = std::max<size_t>(1, std::min(options.threads, puzzles.size()));
+    const SolverOptions workerOptions = splitMemoryLimit(options.solver, numThreads);
+    const WorkerPlacement placement = placeWorkers(options, topology, numThreads);
+    std::mutex outputMutex;
+    std::atomic<size_t> solvedPuzzles(0);
+    SolverMetrics totalMetrics;
+    auto tpBegin = std::chrono::steady_clock::now();
     {
-        for (it2 = keyList2.begin(); it2 != keyList2.end(); ++it2) 
+        ThreadPool pool(numThreads, placement.cpus);
+        for(const std::pair<size_t, std::string>& puzzle : puzzles)
         {
-            CryptoKeyList res = combineTwoKeys(*it1, *it2, false);
-            retVal.insert(retVal.end(), res.begin(), res.end());
+            pool.enqueue([&, puzzle]()
+            {
+                bool solved = false;
+                SolverMetrics metrics;
+                const Solver& solver = placement.solver(solvers, ThreadPool::workerIndex());
+                std::string result = solvePuzzleToJson("\"line\":" + std::to_string(puzzle.first), puzzle.second, solver, workerOptions, solved, metrics);
+                if (solved)
+                {
+                    ++solvedPuzzles;
+                }
+                std::lock_guard<std::mutex> lock(outputMutex);
+                totalMetrics.merge(metrics);
+                std::cout << result << '\n' << std::flush;
+            });
         }
+        pool.wait();
     }
-    return retVal;
+    const double secondsElapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpBegin).count() / 1000000.0;
+
+    std::cerr << "Solved " << solvedPuzzles << " of " << puzzles.size() << " puzzles in " << std::setprecision(3) << std::fixed << secondsElapsed
+        << " s on " << numThreads << " threads: " << (secondsElapsed > 0 ? puzzles.size() / secondsElapsed : 0.0) << " puzzles/s" << std::endl;
+    if (!options.metricsFile.empty() && !writeMetrics(options.metricsFile, totalMetrics, solvers[0]->dictionaryContext(), options.solver.candidateCache))
+    {
+        return 1;
+    }
+    return 0;
 }
 
-int getNumberOfCommonLetterAssigments(const CryptoKey& key1, const CryptoKey& key2)
+// Minimal lookup of a top level member of a flat JSON object, enough for the request format
+// With inOutPosition the search starts there, which is set behind the value found
+bool extractJsonString(const std::string& json, const char* name, std::string& outValue, size_t* inOutPosition = nullptr)
 {
-    int retVal = 0;
-    for(auto index = 0; index < key1.size(); ++index)
+    const std::string key = std::string("\"") + name + "\"";
+    size_t pos = json.find(key, inOutPosition ? *inOutPosition : 0);
+    if (pos == std::string::npos)
     {
-        if((key1.at(index) != '*') && (key2.at(index) != '*'))
-        {
-            retVal++;
+        return false;
+    }
+    pos = json.find_first_not_of(" \t:", pos + key.size());
+    if (pos == std::string::npos || json[pos] != '"')
+    {
+        return false;
+    }
+    outValue.clear();
+    for(++pos; pos < json.size(); ++pos)
+    {
+        char chr = json[pos];
+        if (chr == '"')
+        {
+            if (inOutPosition)
+            {
+                *inOutPosition = pos + 1;
+            }
+            return true;
+        }
+        if (chr == '\\' && pos + 1 < json.size())
+        {
+            chr = json[++pos];
+            if (chr == 'n')
+            {
+                chr = '\n';
+            }
+            else if (chr == 't')
+            {
+                chr = '\t';
+            }
         }
+        outValue += chr;
     }
-    return retVal;
+    return false;
 }
 
-CryptoKeyList combineKeysSuccessOnly(const std::vector<CryptoKeyList>& keyLists, const CombinationList& comboList)
-{
-    CryptoKeyList retVal;
-//    std::vector<CryptoKeyList::const_iterator> vecKeyListIterators;
-//    for(const auto& list : keyLists)
-//    {
-//        keyListIterators.emplace_back(list.begin());
-//    }
-//    int index1 = 0;
-//    int index2 = 1;
-//    int currentCycle;
-//    while(vecKeyListIterators.back() != keyLists.back().end())
-//    {
-//        CryptoKeyList::const_iterator& iterator1 = vecKeyListIterators[index1];
-//
-//        while(index2 < vecKeyListIterators.size())
-//        {
-//            CryptoKeyList::const_iterator& iterator2 = vecKeyListIterators[index2];
-//        }
-//    }
-
-
-    return retVal;
+bool extractJsonNumber(const std::string& json, const char* name, double& outValue, size_t* inOutPosition = nullptr)
+{
+    const std::string key = std::string("\"") + name + "\"";
+    size_t pos = json.find(key, inOutPosition ? *inOutPosition : 0);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    pos = json.find_first_not_of(" \t:", pos + key.size());
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    char* end = nullptr;
+    outValue = std::strtod(json.c_str() + pos, &end);
+    if (inOutPosition)
+    {
+        *inOutPosition = end - json.c_str();
+    }
+    return end != json.c_str() + pos;
 }
 
-CryptoKeyList combineKeysSmart(const std::vector<CryptoKeyList>& keysPerWord)
+// The members of a searchPassToJson object from the position of name on
+bool extractJsonPass(const std::string& json, const char* name, SearchPass& outPass)
 {
-    CryptoKeyList retVal;
-
-    //using TwoWordCombo = std::pair<int, int>;
-    //using NumberOfLetterPerTwoWords = std::pair<int, TwoWordCombo>;
-    //std::vector<NumberOfLetterPerTwoWords> numCommonLetters;
-    size_t numWords = keysPerWord.size();
-    std::vector<int> matrixCommonLetters;
-    matrixCommonLetters.resize(numWords*numWords, 0);
-
-    int maxCommonLetters = 0;
-    for(size_t index1 = 0; index1 < numWords - 1; ++index1)
+    size_t position = json.find(std::string("\"") + name + "\"");
+    double tier = 0.0;
+    if (position == std::string::npos || !extractJsonNumber(json, "tier", tier, &position))
     {
-        for(size_t index2 = index1 + 1; index2 < numWords; ++index2)
+        return false;
+    }
+    position = json.find("\"unknown_words\":[", position);
+    if (position == std::string::npos)
+    {
+        return false;
+    }
+    outPass.tier = static_cast<size_t>(tier);
+    outPass.unknownWords.clear();
+    const char* next = json.c_str() + json.find('[', position) + 1;
+    while (*next != ']' && *next != '\0')
+    {
+        char* end = nullptr;
+        const unsigned long word = std::strtoul(next, &end, 10);
+        if (end == next)
         {
-            int letters = getNumberOfCommonLetterAssigments(keysPerWord[index1][0], keysPerWord[index2][0]);
-
-            matrixCommonLetters[index1][index2] = matrixCommonLetters[index2][index1] = letters;
+            return false;
         }
+        outPass.unknownWords.emplace_back(word);
+        next = *end == ',' ? end + 1 : end;
     }
+    return *next == ']';
+}
 
-
-
-    std::sort(numCommonLetters.begin(), numCommonLetters.end(),
-              [&](const NumberOfLetterPerTwoWords& pair1, const NumberOfLetterPerTwoWords& pair2) ->bool
+// Request latencies of the last maxSamples requests, from reading the line to writing the answer
+class LatencyStats
+{
+public:
+    void add(double milliseconds)
     {
-        bool retVal = false;
-        if(pair1.first > pair2.first)
+        std::lock_guard<std::mutex> lock(mutex);
+        if (samples.size() < maxSamples)
         {
-            retVal = true;
+            samples.emplace_back(milliseconds);
         }
-        else if(pair1.first == pair2.first)
+        else
         {
-            if(std::min(keysPerWord[pair1.second.first].size(), keysPerWord[pair1.second.second].size())
-                    <
-               std::min(keysPerWord[pair2.second.first].size(), keysPerWord[pair2.second.second].size()))
-            {
-                retVal = true;
-            }
+            samples[nextSample] = milliseconds;
         }
-    });
-
-
-    return retVal;
-}
+        nextSample = (nextSample + 1) % maxSamples;
+        ++requests;
+    }
 
-CryptoKeyList combineKeys(const std::vector<CryptoKeyList>& keyList, const CombinationList& comboList)
-{
-    CryptoKeyList retVal;
+    std::string toJson()
+    {
+        std::vector<double> sorted;
+        size_t requestCount;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted = samples;
+            requestCount = requests;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        std::ostringstream json;
+        json << "{\"requests\":" << requestCount << std::setprecision(3) << std::fixed
+            << ",\"p50_ms\":" << getPercentile(sorted, 0.50)
+            << ",\"p99_ms\":" << getPercentile(sorted, 0.99)
+            << ",\"max_ms\":" << (sorted.empty() ? 0.0 : sorted.back()) << "}";
+        return json.str();
+    }
 
-    for (const Combination& combo : comboList)
+private:
+    static double getPercentile(const std::vector<double>& sorted, double fraction)
     {
-        CryptoKeyList currentList;
-        currentList = keyList[0];
-        for (int index = 1; index < combo.size(); ++index) 
+        if (sorted.empty())
         {
-            const CryptoKeyList& keyListOther = keyList[index];
-            std::cout << "Combining key lists with size " << currentList.size() << " and " << keyListOther.size() << std::endl;
-            currentList = combineTwoKeyLists(currentList, keyListOther);
-            std::cout << "New key list: " << currentList.size() << std::endl;
+            return 0.0;
         }
-        retVal.insert(retVal.end(), currentList.begin(), currentList.end());
+        size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
     }
-    return retVal;
-}
 
-template<int NumLetters>
-CryptoText transformText(const CryptoText& sourceText, const CryptoKey& substitutionKey)
+    static constexpr size_t maxSamples = 100000;
+    std::mutex mutex;
+    std::vector<double> samples;
+    size_t nextSample = 0;
+    size_t requests = 0;
+};
+
+// One connected client. The socket is closed when the last reference is gone, so a worker
+// still answering a request never writes to a descriptor reused by a new connection.
+struct ServerClient
 {
-    CryptoText retVal;
-    retVal = sourceText;
-    if (substitutionKey.size() == NumLetters)
+    explicit ServerClient(int socketFd) : fd(socketFd) {}
+    ~ServerClient()
     {
-        for (int index = 0; index < sourceText.size(); ++index)
+        close(fd);
+    }
+
+    void send(const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        size_t written = 0;
+        while (written < line.size())
         {
-            const char& chr = sourceText.at(index);
-            char& chrOut = retVal.at(index);
-            if (chr >= 'A' && chr <= 'Z')
+            ssize_t result = ::send(fd, line.data() + written, line.size() - written, MSG_NOSIGNAL);
+            if (result < 0)
             {
-                chrOut = substitutionKey.c_str()[chr - 'A'];
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
             }
+            written += result;
         }
     }
-    return retVal;
+
+    int fd;
+    std::mutex writeMutex;
+    std::string readBuffer;
+};
+
+struct ServerRequest
+{
+    std::shared_ptr<ServerClient> client;
+    std::string id;
+    std::string text;
+    std::chrono::steady_clock::time_point received;
+    double deadlineMs;
+};
+
+int serverSignalPipe[2] = { -1, -1 };
+
+void onServerSignal(int signalNumber)
+{
+    const char chr = static_cast<char>(signalNumber);
+    ssize_t result = write(serverSignalPipe[1], &chr, 1);
+    (void)result;
 }
 
-CombinationList createAllPermutations(size_t numOfElements)
+// Solver daemon. Every line received on the socket is a request, either the plain
+// cryptogram or {"id":"...","text":"...","deadline_ms":N}, answered with one JSON line.
+// The line STATS returns the latency percentiles. Lines arriving together are handed to
+// the pool as one batch, longest first. The dictionaries (one per NUMA node with --numa)
+// are a shared snapshot: SIGHUP loads new ones in the background and swaps them in,
+// requests in flight finish on the old ones.
+// A request still queued at its deadline is answered with an error, a running one is stopped
+// at the deadline and answered with its best key so far.
+int runServer(const CommandLineOptions& options, const CpuTopology& topology)
 {
-    CombinationList retVal;
-    std::vector<int> initVec;
-    initVec.resize(numOfElements);
-    retVal.reserve(numOfElements*numOfElements);
-    for(auto ind = 0; ind < numOfElements; ++ind)
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe(serverSignalPipe) != 0)
+    {
+        std::cerr << "Error creating the signal pipe" << std::endl;
+        return 1;
+    }
+    fcntl(serverSignalPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(serverSignalPipe[1], F_SETFL, O_NONBLOCK);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onServerSignal;
+    sigaction(SIGHUP, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::shared_ptr<const NodeSolvers> solvers = loadNodeSolvers(options, topology);
+    if (!solvers)
     {
-        initVec[ind] = ind;
+        return 1;
     }
+    setSolverLog(nullptr);
 
-    do
+    int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (listenFd < 0 || options.serveSocket.size() >= sizeof(address.sun_path))
     {
-        retVal.emplace_back(initVec);
-    } while (std::next_permutation(initVec.begin(), initVec.end()));
+        std::cerr << "Invalid socket path " << options.serveSocket << std::endl;
+        return 1;
+    }
+    strncpy(address.sun_path, options.serveSocket.c_str(), sizeof(address.sun_path) - 1);
+    unlink(options.serveSocket.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenFd, 128) != 0)
+    {
+        std::cerr << "Error listening on " << options.serveSocket << ": " << strerror(errno) << std::endl;
+        close(listenFd);
+        return 1;
+    }
+    std::cerr << "Serving on " << options.serveSocket << " with " << options.threads << " threads" << std::endl;
+
+    const SolverOptions workerOptions = splitMemoryLimit(options.solver, options.threads);
+    const WorkerPlacement placement = placeWorkers(options, topology, options.threads);
+    LatencyStats stats;
+    std::mutex metricsMutex;
+    SolverMetrics totalMetrics;
+    std::map<int, std::shared_ptr<ServerClient>> clients;
+    std::atomic<bool> reloading(false);
+    std::thread reloadThread;
+    bool running = true;
+    {
+        ThreadPool pool(options.threads, placement.cpus);
+        while (running)
+        {
+            std::vector<pollfd> pollFds;
+            pollFds.push_back({ serverSignalPipe[0], POLLIN, 0 });
+            pollFds.push_back({ listenFd, POLLIN, 0 });
+            for(const auto& client : clients)
+            {
+                pollFds.push_back({ client.first, POLLIN, 0 });
+            }
+            if (poll(pollFds.data(), pollFds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
 
-    return retVal;
+            if (pollFds[0].revents & POLLIN)
+            {
+                char signalNumber = 0;
+                while (read(serverSignalPipe[0], &signalNumber, 1) == 1)
+                {
+                    if (signalNumber == SIGHUP)
+                    {
+                        if (!reloading.exchange(true))
+                        {
+                            if (reloadThread.joinable())
+                            {
+                                reloadThread.join();
+                            }
+                            std::cerr << "Reloading the wordlists" << std::endl;
+                            reloadThread = std::thread([&]()
+                            {
+                                std::shared_ptr<const NodeSolvers> newSolvers = loadNodeSolvers(options, topology);
+                                if (newSolvers)
+                                {
+                                    std::atomic_store(&solvers, newSolvers);
+                                    std::cerr << "Wordlists reloaded" << std::endl;
+                                }
+                                reloading = false;
+                            });
+                        }
+                    }
+                    else
+                    {
+                        running = false;
+                    }
+                }
+            }
+
+            if (pollFds[1].revents & POLLIN)
+            {
+                int clientFd = accept(listenFd, nullptr, nullptr);
+                if (clientFd >= 0)
+                {
+                    clients[clientFd] = std::make_shared<ServerClient>(clientFd);
+                }
+            }
+
+            std::vector<ServerRequest> requests;
+            const auto now = std::chrono::steady_clock::now();
+            for(size_t index = 2; index < pollFds.size(); ++index)
+            {
+                if (!(pollFds[index].revents & (POLLIN | POLLHUP | POLLERR)))
+                {
+                    continue;
+                }
+                std::shared_ptr<ServerClient> client = clients[pollFds[index].fd];
+                char buffer[65536];
+                ssize_t received = read(client->fd, buffer, sizeof(buffer));
+                if (received <= 0)
+                {
+                    clients.erase(client->fd);
+                    continue;
+                }
+                client->readBuffer.append(buffer, received);
+                size_t lineEnd;
+                while ((lineEnd = client->readBuffer.find('\n')) != std::string::npos)
+                {
+                    std::string line = client->readBuffer.substr(0, lineEnd);
+                    client->readBuffer.erase(0, lineEnd + 1);
+                    if (!line.empty() && line.back() == '\r')
+                    {
+                        line.pop_back();
+                    }
+                    if (line.empty())
+                    {
+                        continue;
+                    }
+                    if (line == "STATS")
+                    {
+                        client->send(stats.toJson() + "\n");
+                        continue;
+                    }
+                    ServerRequest request;
+                    request.client = client;
+                    request.received = now;
+                    request.deadlineMs = static_cast<double>(options.deadlineMs);
+                    if (line[0] == '{')
+                    {
+                        extractJsonString(line, "id", request.id);
+                        extractJsonString(line, "text", request.text);
+                        extractJsonNumber(line, "deadline_ms", request.deadlineMs);
+                    }
+                    else
+                    {
+                        request.text = line;
+                    }
+                    requests.emplace_back(std::move(request));
+                }
+            }
+
+            std::stable_sort(requests.begin(), requests.end(), [](const ServerRequest& request1, const ServerRequest& request2) -> bool
+            {
+                return request1.text.size() > request2.text.size();
+            });
+            for(ServerRequest& request : requests)
+            {
+                std::shared_ptr<const NodeSolvers> snapshot = std::atomic_load(&solvers);
+                pool.enqueue([&stats, &workerOptions, &placement, &metricsMutex, &totalMetrics, snapshot, request]()
+                {
+                    const std::string idMember = "\"id\":\"" + escapeJson(request.id) + "\"";
+                    std::string result;
+                    const double waitedMs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.received).count() / 1000.0;
+                    if (request.deadlineMs > 0 && waitedMs > request.deadlineMs)
+                    {
+                        result = "{" + idMember + ",\"error\":\"deadline exceeded before solving\"}";
+                    }
+                    else
+                    {
+                        // the rest of the deadline bounds the search, which then answers with its best key so far
+                        SolverOptions requestOptions = workerOptions;
+                        if (request.deadlineMs > 0)
+                        {
+                            const double remainingMs = request.deadlineMs - waitedMs;
+                            requestOptions.timeLimitMs = workerOptions.timeLimitMs > 0 ? std::min(workerOptions.timeLimitMs, remainingMs) : remainingMs;
+                        }
+                        bool solved = false;
+                        SolverMetrics metrics;
+                        const Solver& solver = placement.solver(*snapshot, ThreadPool::workerIndex());
+                        result = solvePuzzleToJson(idMember, request.text, solver, requestOptions, solved, metrics);
+                        std::lock_guard<std::mutex> lock(metricsMutex);
+                        totalMetrics.merge(metrics);
+                    }
+                    stats.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.received).count() / 1000.0);
+                    request.client->send(result + "\n");
+                });
+            }
+        }
+        pool.wait();
+    }
+    if (reloadThread.joinable())
+    {
+        reloadThread.join();
+    }
+    clients.clear();
+    close(listenFd);
+    unlink(options.serveSocket.c_str());
+    std::cerr << "Server stopped, latency " << stats.toJson() << std::endl;
+    if (!options.metricsFile.empty()
+        && !writeMetrics(options.metricsFile, totalMetrics, (*solvers)[0]->dictionaryContext(), options.solver.candidateCache))
+    {
+        return 1;
+    }
+    return 0;
 }
 
-CombinationList createSingleCombination(size_t numOfElements)
+// host:port (the host may be empty) is a TCP address, anything else a Unix socket path
+bool splitTcpAddress(const std::string& address, std::string& outHost, std::string& outPort)
 {
-    CombinationList retVal;
-    retVal.resize(1);
-    for(auto ind = 0; ind < numOfElements; ++ind)
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon + 1 == address.size() || address.find('/') != std::string::npos)
     {
-        retVal[0].emplace_back(ind);
+        return false;
     }
-
-    return retVal;
+    outHost = address.substr(0, colon);
+    outPort = address.substr(colon + 1);
+    return outPort.find_first_not_of("0123456789") == std::string::npos;
 }
 
-void analyseWord(Word& word, LetterFrequencyMap& freqMap)
+// A socket listening on or connected to address, -1 with the reason in outError
+int openSocket(const std::string& address, bool listening, std::string& outError)
 {
-    for (auto index = 0; index < word.size(); ++index)
+    std::string host;
+    std::string port;
+    if (splitTcpAddress(address, host, port))
     {
-        const char chr = word.at(index);
-        if (freqMap.find(chr) == freqMap.end())
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+        addrinfo* addresses = nullptr;
+        const int result = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+        if (result != 0)
         {
-            freqMap[chr] = 0;
+            outError = gai_strerror(result);
+            return -1;
+        }
+        int retVal = -1;
+        for(addrinfo* info = addresses; info && retVal < 0; info = info->ai_next)
+        {
+            retVal = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+            if (retVal < 0)
+            {
+                continue;
+            }
+            const int enable = 1;
+            setsockopt(retVal, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            setsockopt(retVal, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            const bool opened = listening ? bind(retVal, info->ai_addr, info->ai_addrlen) == 0 && listen(retVal, 128) == 0
+                : connect(retVal, info->ai_addr, info->ai_addrlen) == 0;
+            if (!opened)
+            {
+                outError = strerror(errno);
+                close(retVal);
+                retVal = -1;
+            }
         }
-        freqMap[chr]++;
+        freeaddrinfo(addresses);
+        return retVal;
     }
-}
 
-void loadWordListIntoSet(const std::string& filename, WordList& outSet, LetterFrequencyMap& freqMap)
-{
-    std::cout << "Start loading wordlist from file: " << std::endl << filename << std::endl;
-    auto tpBegin = std::chrono::system_clock::now();
-    std::ifstream wordlistFile(filename);
-    outSet.reserve(4000000);
-    if (wordlistFile.is_open())
+    sockaddr_un socketAddress;
+    memset(&socketAddress, 0, sizeof(socketAddress));
+    socketAddress.sun_family = AF_UNIX;
+    if (address.empty() || address.size() >= sizeof(socketAddress.sun_path))
     {
-        std::string line;
-        // get length of file:
-        wordlistFile.seekg(0, wordlistFile.end);
-        std::streamoff fileSize = wordlistFile.tellg();
-        wordlistFile.seekg(0, wordlistFile.beg);
-        Word word;
-        while (std::getline(wordlistFile, line))
+        outError = "invalid socket path";
+        return -1;
+    }
+    strncpy(socketAddress.sun_path, address.c_str(), sizeof(socketAddress.sun_path) - 1);
+    int retVal = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening)
+    {
+        unlink(address.c_str());
+    }
+    const bool opened = retVal >= 0 && (listening
+        ? bind(retVal, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) == 0 && listen(retVal, 128) == 0
+        : connect(retVal, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) == 0);
+    if (!opened)
+    {
+        outError = strerror(errno);
+        if (retVal >= 0)
         {
-            std::transform(line.begin(), line.end(), line.begin(), ::toupper);
-            word = line;
-            //analyseWord(word, freqMap);
-            outSet.insert(word);
+            close(retVal);
         }
-        auto tpEnd = std::chrono::system_clock::now();
-        auto millisecondsElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(tpEnd - tpBegin).count();
-
-        double secondsElapsed = millisecondsElapsed / 1000.0;
-
-        std::cout << "Wordlist loaded in " << std::setprecision(3) << std::fixed << secondsElapsed << " s" << std::endl;
-        std::cout << "Word count: " << outSet.size() << " words" << std::endl;
-        std::cout << "Speed: " << std::setprecision(3) << fileSize / secondsElapsed / 1024 / 1024 << " MB/s" << std::endl;
+        retVal = -1;
+    }
+    return retVal;
+}
 
+// Moves the complete lines of the connection into outLines, false when it is closed
+bool receiveLines(ServerClient& connection, std::vector<std::string>& outLines)
+{
+    char buffer[65536];
+    ssize_t received = read(connection.fd, buffer, sizeof(buffer));
+    if (received < 0 && errno == EINTR)
+    {
+        return true;
     }
-    else
+    if (received <= 0)
+    {
+        return false;
+    }
+    connection.readBuffer.append(buffer, received);
+    size_t lineEnd;
+    while ((lineEnd = connection.readBuffer.find('\n')) != std::string::npos)
     {
-        std::cout << "Error opening file" << std::endl;
+        outLines.emplace_back(connection.readBuffer.substr(0, lineEnd));
+        connection.readBuffer.erase(0, lineEnd + 1);
     }
+    return true;
 }
 
-template<int NumLetters>
-CryptoKeyData MutateKey(const CryptoKeyData& sourceKeyData, std::set<char>& goodPos, LetterFrequencyMap& freqMap)
+// Worker process of a coordinated solve. It connects to the coordinator and solves the
+// shards it is handed, {"shard":i,"shards":S,"text":"..."}, one at a time with its own
+// options. Each answer is the JSON line of batch mode with the shard instead of the line.
+// CANCEL stops the shard being solved, which then answers with what it has, and the worker
+// exits when the coordinator closes the connection.
+int runWorker(const CommandLineOptions& options)
 {
-    CryptoKeyData retVal = sourceKeyData;
-    CryptoKey& keyToMutate = retVal.first;
-    std::uniform_int_distribution<unsigned int> mutateGoodChanceDist(0, 1000);
-    std::uniform_int_distribution<unsigned int> letterDist(0, ALPHABET_LETTERS_NUM - 1);
-    unsigned int rnd;
-    unsigned int chance;
-    unsigned int allLettersNum = 0;
-    for (auto it = freqMap.begin(); it != freqMap.end(); ++it) 
+    signal(SIGPIPE, SIG_IGN);
+    setSolverLog(nullptr);
+    std::string error;
+    std::shared_ptr<const DictionaryContext> dictionary = DictionaryContext::load(options.wordlists, true, &error);
+    if (!dictionary)
     {
-        allLettersNum += it->second;
+        std::cerr << "Error loading the wordlists: " << error << std::endl;
+        return 1;
     }
-    std::uniform_int_distribution<unsigned int> freqDist(0, allLettersNum - 1);
-    unsigned int rndNew = freqDist(e1);
-    do
+    const Solver solver(dictionary);
+    // the coordinator may still be starting
+    int fd = -1;
+    for(int attempt = 0; attempt < 100 && fd < 0; ++attempt)
     {
-        rnd = letterDist(e1);
-        chance = mutateGoodChanceDist(e1);
-    } while ((goodPos.find(rnd) != goodPos.end()) && (chance > mutateGoodLetterFactor));
-    char& chrToMutate = keyToMutate.at(rnd);
-    char newVal=0;
-    unsigned int freqWalker = 0;
-
-    for (auto it = freqMap.begin(); it != freqMap.end(); ++it) 
+        fd = openSocket(options.workerAddress, false, error);
+        if (fd < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    if (fd < 0)
+    {
+        std::cerr << "Error connecting to the coordinator " << options.workerAddress << ": " << error << std::endl;
+        return 1;
+    }
+    ServerClient coordinator(fd);
+    std::vector<std::string> lines;
+    bool connected = true;
+    while (connected)
     {
-        freqWalker += it->second;
-        if (freqWalker >= allLettersNum - rndNew) 
+        if (lines.empty())
         {
-            newVal = it->first;
-            break;
+            connected = receiveLines(coordinator, lines);
+            continue;
+        }
+        const std::string line = lines.front();
+        lines.erase(lines.begin());
+        std::string text;
+        double shard = 0.0;
+        double shards = 0.0;
+        if (!extractJsonString(line, "text", text) || !extractJsonNumber(line, "shard", shard) || !extractJsonNumber(line, "shards", shards))
+        {
+            // also a CANCEL of a shard that was answered already
+            continue;
+        }
+        std::shared_ptr<CancellationToken> cancellation = std::make_shared<CancellationToken>();
+        SolverOptions shardOptions = options.solver;
+        shardOptions.shardIndex = static_cast<size_t>(shard);
+        shardOptions.shardCount = static_cast<size_t>(shards);
+        extractJsonPass(line, "pass", shardOptions.shardPass);
+        shardOptions.cancellation = cancellation;
+        // the connection is watched while solving, for CANCEL or the coordinator going away
+        std::atomic<bool> solving(true);
+        std::thread watcher([&]()
+        {
+            while (solving && connected)
+            {
+                pollfd pollFd = { fd, POLLIN, 0 };
+                if (poll(&pollFd, 1, 50) <= 0)
+                {
+                    continue;
+                }
+                std::vector<std::string> received;
+                connected = receiveLines(coordinator, received);
+                for(const std::string& receivedLine : received)
+                {
+                    if (receivedLine == "CANCEL")
+                    {
+                        cancellation->cancel();
+                    }
+                    else
+                    {
+                        lines.emplace_back(receivedLine);
+                    }
+                }
+                if (!connected)
+                {
+                    cancellation->cancel();
+                }
+            }
+        });
+        bool solved = false;
+        SolverMetrics metrics;
+        const std::string result = solvePuzzleToJson("\"shard\":" + std::to_string(shardOptions.shardIndex), text, solver, shardOptions, solved, metrics);
+        solving = false;
+        watcher.join();
+        if (connected)
+        {
+            coordinator.send(result + "\n");
         }
     }
-
-    keyToMutate.at(keyToMutate.find_first_of(newVal)) = chrToMutate;
-    chrToMutate = newVal;
-    return retVal;
+    return 0;
 }
 
-size_t splitLineToWords(const CryptoText& line, WordArray& outVec)
+// The keys of a result line of solvePuzzleToJson
+std::vector<RankedKey> parseResultKeys(const std::string& json)
 {
-    size_t retVal = 0;
-    size_t strPos = 0;
-    size_t oldPos = 0;
-    while (strPos != CryptoText::npos)
+    std::vector<RankedKey> retVal;
+    size_t position = json.find("\"keys\":[");
+    RankedKey key;
+    while (position != std::string::npos && extractJsonString(json, "key", key.key, &position)
+           && extractJsonString(json, "plaintext", key.plaintext, &position) && extractJsonNumber(json, "quality", key.quality, &position))
     {
-        strPos = line.find_first_of(' ', oldPos);
-        if (strPos != CryptoText::npos)
-        {
-            outVec.at(retVal) = line.substr(oldPos, strPos - oldPos);
-            retVal++;
-            oldPos = strPos + 1;
-        }
+        retVal.emplace_back(key);
     }
-    //handle last word
-    outVec.at(retVal) = line.substr(oldPos, line.size() - oldPos);
-    retVal++;
     return retVal;
 }
 
-double calcTextQuality(const CryptoText& text, const WordList& wordList)
+// The keys of the finished shards and of a shard stopped by the time limit, best first and
+// at most maxSolutions like a single solve. Returns the number of full keys.
+size_t printShardKeys(const CommandLineOptions& options, const SolveCheckpoint& checkpoint, const std::vector<RankedKey>& unfinishedKeys,
+                      size_t unfinishedSolutions, bool interrupted, bool truncated)
 {
-    double retVal;
-    WordArray arrayWords;
-    size_t numWords = splitLineToWords(text, arrayWords);
-    size_t allTextLength = 0;
-    size_t goodTextLength = 0;
-    int good = 0;
-    for (auto wordIndex = 0; wordIndex < numWords; ++wordIndex)
+    std::vector<RankedKey> keys = checkpoint.shardKeys();
+    for(const RankedKey& key : unfinishedKeys)
     {
-        const Word& word = arrayWords.at(wordIndex);
-        allTextLength += word.size();
-        if (wordList.find(word) != wordList.end())
+        if (std::none_of(keys.begin(), keys.end(), [&](const RankedKey& other) { return other.key == key.key; }))
         {
-            goodTextLength += word.size();
-            ++good;
-            for(auto index = 0; index < word.size(); ++index)
-            {
-                char chr = word.at(index);
-            }
+            keys.emplace_back(key);
         }
     }
-    retVal = (double)goodTextLength / (double)allTextLength;
+    std::stable_sort(keys.begin(), keys.end(), [](const RankedKey& key1, const RankedKey& key2) -> bool
+    {
+        return key1.quality > key2.quality;
+    });
+    if (keys.size() > options.solver.maxSolutions)
+    {
+        keys.resize(options.solver.maxSolutions);
+    }
+    const size_t retVal = checkpoint.shardSolutions() + unfinishedSolutions;
+    if (interrupted)
+    {
+        std::cout << "Stopped by the time limit, " << retVal << " full keys found" << std::endl;
+    }
+    if (truncated || checkpoint.isTruncated())
+    {
+        std::cout << "Key lists reached the memory limit, keys may be missing" << std::endl;
+    }
+    for(const RankedKey& key : keys)
+    {
+        printSolution(key);
+    }
     return retVal;
 }
 
-void removeElementWithCryptoKey(SolutionMap& sMap, const CryptoKeyData& cKey, int iterations) 
+// A solve whose shards all finished without a full key goes on with the next pass of the
+// widening for all shards, like a single solve would. false if there is none.
+bool startNextPass(const CommandLineOptions& options, SolveCheckpoint& checkpoint)
 {
-    for (auto it = sMap.begin(); it != sMap.end(); ++it) 
+    SearchPass nextPass;
+    if (checkpoint.doneShards() < options.shards || checkpoint.shardSolutions() > 0 || !checkpoint.getNextPass(nextPass))
     {
-        const CryptoKey& elementKey = (*it).second.first.first;
-        if (elementKey == cKey.first) 
-        {
-            std::cout << "Removing solution   (Q: " << it->first 
-                << " K:" << std::setfill(' ') << std::setw(8) << iterations <<
-                "): " << it->second.second.c_str() << std::endl;
-            sMap.erase(it);
-            break;
-        }
+        return false;
     }
+    if (!options.quiet)
+    {
+        std::cout << "No shard found a full key, widening to dictionary tier " << nextPass.tier + 1 << " with "
+            << nextPass.unknownWords.size() << " more unknown words" << std::endl;
+    }
+    std::string error;
+    if (!checkpoint.startPass(nextPass, &error))
+    {
+        std::cerr << error << std::endl;
+    }
+    return true;
 }
 
-void addOneBetterSolution(SolutionMap& sMap, std::mutex& mapMutex, const CryptoKeyData& initialKey, const CryptoText& cryptoText, WordList& wordList, LetterFrequencyMap& freqMap)
+struct ShardWorker
 {
-    bool added = false;
-    CryptoKeyData newKeyData = initialKey;
-    CryptoText decryptedText = transformText<ALPHABET_LETTERS_NUM>(cryptoText, initialKey.first);
-    std::set<char> goodPositions;
-    const double minQuality = calcTextQuality(decryptedText, wordList);
-    while (!added)
+    std::shared_ptr<ServerClient> connection;
+    int shard = -1;             // the shard it solves, -1 while idle
+    size_t pass = 0;            // the pass of the shard, an answer to an earlier pass is dropped
+};
+
+struct ShardState
+{
+    bool done = false;
+    size_t running = 0;         // workers solving it, two once a straggler was duplicated
+    std::chrono::steady_clock::time_point started;
+};
+
+// Splits the solve of the cryptogram into shards for the worker processes that connect to
+// the coordinator address, the --local-workers of them started from this binary with the
+// same options. An idle worker gets the next shard. When none is left it duplicates the
+// shard that has been running the longest, the first answer counts and the copy is
+// cancelled. The shard of a worker that disconnects goes back to the queue. In climb mode
+// the first shard with a full key ends the solve. When all shards of an enumeration found
+// no full key, they are solved again with the next pass. The keys of all shards are ranked
+// by quality like the keys of a single solve. Shards finished in the checkpoint are
+// skipped, the others are added to it as they finish.
+int runCoordinator(const CommandLineOptions& options, SolveCheckpoint& checkpoint, int argc, char* argv[])
+{
+    signal(SIGPIPE, SIG_IGN);
+    std::string error;
+    const int listenFd = openSocket(options.coordinateAddress, true, error);
+    if (listenFd < 0)
+    {
+        std::cerr << "Error listening on " << options.coordinateAddress << ": " << error << std::endl;
+        return 1;
+    }
+
+    // the local workers get the solver options of the coordinator
+    std::vector<std::string> workerArguments;
+    for(int index = 1; index < argc; ++index)
     {
-        newKeyData = MutateKey<ALPHABET_LETTERS_NUM>(newKeyData, goodPositions, freqMap);
-        newKeyData.second++;
-        if (newKeyData.second >= keyTryLimit)
+        const std::string argument = argv[index];
+        if (argument == "--coordinate" || argument == "--shards" || argument == "--local-workers" || argument == "--checkpoint"
+            || argument == "--checkpoint-interval-ms")
         {
-            mapMutex.lock();
-            removeElementWithCryptoKey(sMap, initialKey, newKeyData.second);
-            mapMutex.unlock();
-            break;
+            ++index;
         }
-        decryptedText = transformText<ALPHABET_LETTERS_NUM>(cryptoText, newKeyData.first);
-        double quality = calcTextQuality(decryptedText, wordList);
-        //std::cout << decryptedText << std::endl;
-        if (quality > minQuality)
+        else if (argument != "--resume")
         {
-            auto pair = std::make_pair(newKeyData, decryptedText);
-            mapMutex.lock();
-            sMap.insert(std::make_pair(quality, pair));
-            mapMutex.unlock();
-            std::cout << "New better solution (Q: " << std::setprecision(4) << std::fixed << quality 
-                << " K:" << std::setfill(' ') << std::setw(8) << newKeyData.second
-                << "): " << decryptedText.c_str() << std::endl;
-            added = true;
+            workerArguments.emplace_back(argument);
         }
     }
-}
-
-void removeRandomMember(CryptoKeySet& outSet)
-{
-    std::uniform_int_distribution<size_t> dist(0, outSet.size() - 1);
-    size_t rnd = dist(e1);
-
-    size_t cntIter = 0;
-    for (auto it = outSet.begin(); it != outSet.end(); ++it) 
+    workerArguments.emplace_back("--worker");
+    workerArguments.emplace_back(options.coordinateAddress);
+    // a resumed solve may have stopped after the last shard of a pass or have nothing left to do
+    startNextPass(options, checkpoint);
+    const bool resumedDone = checkpoint.doneShards() == options.shards
+        || (isClimbMode(options.solver.mode) && checkpoint.shardSolutions() > 0);
+    std::vector<pid_t> localWorkers;
+    for(size_t index = 0; index < options.localWorkers && !resumedDone; ++index)
     {
-        if (cntIter == rnd) 
+        const pid_t pid = fork();
+        if (pid == 0)
         {
-            outSet.erase(it);
-            break;
+            close(listenFd);
+            std::vector<char*> arguments(1, argv[0]);
+            for(std::string& argument : workerArguments)
+            {
+                arguments.emplace_back(&argument[0]);
+            }
+            arguments.emplace_back(nullptr);
+            execv("/proc/self/exe", arguments.data());
+            _exit(127);
+        }
+        if (pid > 0)
+        {
+            localWorkers.emplace_back(pid);
         }
-        cntIter++;
     }
-}
-template<int NumLetters>
-void addRandomKey(CryptoKeySet& outSet)
-{
-    CryptoKey newKey;
-    std::uniform_int_distribution<int> randomLetter('A', 'Z');
-    while (newKey.size() < NumLetters)
+
+    auto tpBegin = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() -> double
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpBegin).count() / 1000.0;
+    };
+    std::vector<ShardState> shards(options.shards);
+    for(size_t index = 0; index < shards.size(); ++index)
     {
-        char chr = static_cast<char>(randomLetter(e1));
-        if (newKey.find_first_of(chr) == CryptoKey::npos)
+        shards[index].done = checkpoint.isShardDone(index);
+    }
+    std::map<int, ShardWorker> workers;
+    size_t doneShards = checkpoint.doneShards();
+    std::vector<RankedKey> unfinishedKeys;
+    size_t unfinishedSolutions = 0;
+    size_t connectedWorkers = 0;
+    bool interrupted = false;
+    bool truncated = false;
+    bool finished = resumedDone;
+    size_t passNumber = 0;
+    int retVal = 0;
+
+    auto assignShard = [&](ShardWorker& worker)
+    {
+        int shard = -1;
+        for(size_t index = 0; index < shards.size() && shard < 0; ++index)
         {
-            newKey.push_back(chr);
+            if (!shards[index].done && shards[index].running == 0)
+            {
+                shard = static_cast<int>(index);
+            }
         }
-    }
-    outSet.insert(std::move(newKey));
-}
+        if (shard < 0)
+        {
+            // no shard left, the one running the longest gets a second worker
+            for(size_t index = 0; index < shards.size(); ++index)
+            {
+                if (!shards[index].done && shards[index].running == 1 && (shard < 0 || shards[index].started < shards[shard].started))
+                {
+                    shard = static_cast<int>(index);
+                }
+            }
+        }
+        if (shard < 0)
+        {
+            return;
+        }
+        if (shards[shard].running++ == 0)
+        {
+            shards[shard].started = std::chrono::steady_clock::now();
+        }
+        worker.shard = shard;
+        worker.pass = passNumber;
+        worker.connection->send("{\"shard\":" + std::to_string(shard) + ",\"shards\":" + std::to_string(shards.size())
+                                + ",\"pass\":" + searchPassToJson(checkpoint.pass())
+                                + ",\"text\":\"" + escapeJson(options.cryptogram) + "\"}\n");
+    };
 
-template<int NumLetters>
-CryptoKeySet getBestKeys(const SolutionMap& sMap, int numberOfKeys)
-{
-    CryptoKeySet retVal;
+    auto completeShard = [&](ShardWorker& worker, const std::string& line)
+    {
+        const int shard = worker.shard;
+        worker.shard = -1;
+        if (shard < 0 || worker.pass != passNumber)
+        {
+            return;
+        }
+        --shards[shard].running;
+        if (shards[shard].done)
+        {
+            return;
+        }
+        shards[shard].done = true;
+        ++doneShards;
+        std::string shardError;
+        if (extractJsonString(line, "error", shardError))
+        {
+            std::cerr << "Can not solve the cryptogram: " << shardError << std::endl;
+            retVal = 1;
+            finished = true;
+            return;
+        }
+        double shardSolutions = 0.0;
+        extractJsonNumber(line, "solutions", shardSolutions);
+        const std::vector<RankedKey> shardKeys = parseResultKeys(line);
+        const bool shardTruncated = line.find("\"truncated\":true") != std::string::npos;
+        SearchPass nextPass;
+        if (extractJsonPass(line, "next_pass", nextPass))
+        {
+            checkpoint.setNextPass(nextPass);
+        }
+        // a shard stopped by the time limit is solved again by a resumed run
+        if (line.find("\"interrupted\":true") != std::string::npos)
+        {
+            interrupted = true;
+            truncated = truncated || shardTruncated;
+            unfinishedKeys.insert(unfinishedKeys.end(), shardKeys.begin(), shardKeys.end());
+            unfinishedSolutions += static_cast<size_t>(shardSolutions);
+        }
+        else if (!checkpoint.completeShard(shard, shardKeys, static_cast<size_t>(shardSolutions), shardTruncated, &shardError))
+        {
+            std::cerr << shardError << std::endl;
+        }
+        for(auto& other : workers)
+        {
+            if (other.second.shard == shard)
+            {
+                other.second.connection->send("CANCEL\n");
+            }
+        }
+        if (!options.quiet)
+        {
+            std::cout << "Shard " << shard + 1 << " of " << shards.size() << " done after " << std::setprecision(3) << std::fixed
+                << elapsedMs() << " ms, " << static_cast<size_t>(shardSolutions) << " full keys" << std::endl;
+        }
+        finished = doneShards == shards.size() || (isClimbMode(options.solver.mode) && shardSolutions > 0);
+        if (finished && !interrupted && startNextPass(options, checkpoint))
+        {
+            for(ShardState& state : shards)
+            {
+                state = ShardState();
+            }
+            doneShards = 0;
+            ++passNumber;
+            finished = false;
+        }
+    };
 
-    for (auto it = sMap.rbegin(); it != sMap.rend(); ++it)
+    while (!finished)
     {
-        retVal.insert(it->second.first.first);
-        if (retVal.size() >= numberOfKeys) // we gathered numberOfKeys
+        std::vector<pollfd> pollFds;
+        pollFds.push_back({ listenFd, POLLIN, 0 });
+        for(const auto& worker : workers)
+        {
+            pollFds.push_back({ worker.first, POLLIN, 0 });
+        }
+        if (poll(pollFds.data(), pollFds.size(), 500) < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if (pollFds[0].revents & POLLIN)
+        {
+            const int workerFd = accept(listenFd, nullptr, nullptr);
+            if (workerFd >= 0)
+            {
+                ShardWorker& worker = workers[workerFd];
+                worker.connection = std::make_shared<ServerClient>(workerFd);
+                ++connectedWorkers;
+                assignShard(worker);
+            }
+        }
+        for(size_t index = 1; index < pollFds.size() && !finished; ++index)
         {
-            auto itNext = it;
-            ++itNext;
-            if (itNext != sMap.rend()) // we are not at the last place (first)
+            if (!(pollFds[index].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            ShardWorker& worker = workers[pollFds[index].fd];
+            std::vector<std::string> lines;
+            const bool connected = receiveLines(*worker.connection, lines);
+            for(const std::string& line : lines)
             {
-                if (itNext->first == it->first) // if the next Solution is with the same quality we add it too
+                completeShard(worker, line);
+            }
+            if (!connected)
+            {
+                if (worker.shard >= 0 && worker.pass == passNumber)
                 {
-                    continue;
+                    --shards[worker.shard].running;
                 }
+                workers.erase(pollFds[index].fd);
             }
+        }
+        for(auto& worker : workers)
+        {
+            if (worker.second.shard < 0 && !finished)
+            {
+                assignShard(worker.second);
+            }
+        }
+        // local workers that exited, without any left nobody would ever finish the shards
+        int status = 0;
+        pid_t exited;
+        while ((exited = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            localWorkers.erase(std::remove(localWorkers.begin(), localWorkers.end(), exited), localWorkers.end());
+        }
+        if (options.localWorkers > 0 && localWorkers.empty() && workers.empty() && !finished)
+        {
+            std::cerr << "All local workers exited" << std::endl;
+            retVal = 1;
             break;
         }
     }
 
-    while (retVal.size() > numberOfKeys)
+    // closing the connections cancels the copies still running and ends the workers
+    workers.clear();
+    close(listenFd);
+    std::string host;
+    std::string port;
+    if (!splitTcpAddress(options.coordinateAddress, host, port))
     {
-        removeRandomMember(retVal);
+        unlink(options.coordinateAddress.c_str());
     }
-
-    while (retVal.size() < numberOfKeys)
+    for(const pid_t pid : localWorkers)
     {
-        addRandomKey<NumLetters>(retVal);
+        waitpid(pid, nullptr, 0);
     }
-
-    return retVal;
-}
-
-
-void printSolution(const CryptoText& text, const CryptoKey& key, const WordList& wordList)
-{
-    if (key.find_first_of('*') != CryptoKey::npos) 
+    if (retVal != 0)
     {
-        CryptoText decrypted = transformText<ALPHABET_LETTERS_NUM>(text, key);
-        double quality = calcTextQuality(decrypted, wordList);
-        std::cout << "Key: " << key.c_str() << " Q(" << std::setprecision(4) << std::fixed << quality
-            << ") Decrypted: " << decrypted.c_str() << std::endl;
+        return retVal;
     }
+
+    const size_t solutions = printShardKeys(options, checkpoint, unfinishedKeys, unfinishedSolutions, interrupted, truncated);
+    std::cout << solutions << " full keys from " << doneShards << " of " << shards.size() << " shards on " << connectedWorkers
+        << " workers in " << std::setprecision(3) << std::fixed << elapsedMs() << " ms" << std::endl;
+    return 0;
 }
 
-int main(int argc, char *argv[])
+// An enumeration with a checkpoint runs as --shards shards one after the other. Every
+// finished shard is saved with its keys, so a resumed run only solves the others. When all
+// shards found no full key they are solved again with the next pass. The shards share the
+// time limit, one stopped by it is not saved. The metrics are the sums of the shards this
+// run solved.
+int runCheckpointedSolve(const CommandLineOptions& options, const Solver& solver, SolveCheckpoint& checkpoint)
 {
-    WordList wordList;
-    LetterFrequencyMap freqMap;
-    loadWordListIntoSet(wordlistName, wordList, freqMap);
-    WordPatternMap patternMap;
-    patternMap = createPatternMap(wordList);
-    std::string cryptogramText = "TUQS MGZI BHDDWA MGZSP ZI GUVT";
-    //std::cout << "Enter cryptogram:" << std::endl;
-    //std::getline(std::cin, cryptogramText);
-    //std::transform(cryptogramText.begin(), cryptogramText.end(), cryptogramText.begin(), ::toupper);
-    CryptoText cryptogramTextFixed = cryptogramText;
-    if (wordList.size() > 0)
+    auto tpBegin = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() -> double
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpBegin).count() / 1000.0;
+    };
+    std::vector<RankedKey> unfinishedKeys;
+    size_t unfinishedSolutions = 0;
+    bool interrupted = false;
+    bool truncated = false;
+    SolverMetrics totalMetrics;
+    bool widened = true;
+    while (widened)
     {
-        WordArray arrayWords;
-        size_t numWords = splitLineToWords(cryptogramTextFixed, arrayWords);
-        CryptoKeyList matchingKeys;
-        std::vector<CryptoKeyList> keysPerWord;
-        keysPerWord.resize(numWords);
-        for(size_t index = 0; index < numWords; ++index)
+        for(size_t shard = 0; shard < options.shards && !interrupted; ++shard)
         {
-            Word& word = arrayWords[index];
-            Word pattern = getWordPattern(word);
-            WordPatternMap::const_iterator it = patternMap.find(pattern);
-            if(it != patternMap.end())
+            if (checkpoint.isShardDone(shard))
             {
-                const WordList& matchingWordList = it->second;
-
-                keysPerWord[index] = getMatchingKeys(word, matchingWordList);
+                continue;
             }
-        }
-#if(NAIVE_COMBINATON == 1)
-        CombinationList allCombinations = createSingleCombination(numWords);
-#else
-        CombinationList allCombinations = createAllPermutations(numWords);
-#endif
-        size_t maxThreads = std::thread::hardware_concurrency();
-        std::vector<CombinationList> combinationsPerThread;
-        maxThreads = std::min(maxThreads, allCombinations.size());
-        combinationsPerThread.resize(maxThreads);
-        size_t threadId = 0;
-        for(const Combination& combo : allCombinations)
-        {
-            combinationsPerThread[threadId].emplace_back(combo);
-            if (threadId < maxThreads - 1)
+            SolverOptions shardOptions = options.solver;
+            shardOptions.shardIndex = shard;
+            shardOptions.shardCount = options.shards;
+            shardOptions.shardPass = checkpoint.pass();
+            if (options.solver.timeLimitMs > 0)
             {
-                ++threadId;
+                shardOptions.timeLimitMs = options.solver.timeLimitMs - elapsedMs();
+                if (shardOptions.timeLimitMs <= 0)
+                {
+                    interrupted = true;
+                    break;
+                }
             }
-            else 
+            const SolverResult result = solver.solve(options.cryptogram, shardOptions);
+            flushSolverLog();
+            totalMetrics.merge(result.metrics);
+            if (!result.error.empty())
             {
-                threadId = 0;
+                std::cout << "Can not solve the cryptogram: " << result.error << std::endl;
+                return 1;
             }
-        }
-
-        std::vector<CryptoKeyList> keysPerWordSorted;
-        keysPerWordSorted.reserve(numWords);
-
-        std::vector<bool> insertedWordIndexes;
-        insertedWordIndexes.resize(numWords, false);
-        for(const NumberOfLetterPerTwoWords& numLettersInfo : numCommonLetters)
-        {
-            const CryptoKeyList& firstListOfCombo = keysPerWord[numLettersInfo.second.first];
-            const CryptoKeyList& secondListOfCombo = keysPerWord[numLettersInfo.second.second];
-
-            if(firstListOfCombo.size() < secondListOfCombo.size())
+            std::string error;
+            if (result.hasNextPass)
             {
-                if(!insertedWordIndexes[numLettersInfo.second.first])
-                {
-                    keysPerWordSorted.emplace_back(firstListOfCombo);
-                    insertedWordIndexes[numLettersInfo.second.first] = true;
-                }
-                if(!insertedWordIndexes[numLettersInfo.second.second])
-                {
-                    keysPerWordSorted.emplace_back(secondListOfCombo);
-                    insertedWordIndexes[numLettersInfo.second.second] = true;
-                }
+                checkpoint.setNextPass(result.nextPass);
             }
-            else
+            if (result.interrupted)
             {
-                if(!insertedWordIndexes[numLettersInfo.second.second])
-                {
-                    keysPerWordSorted.emplace_back(secondListOfCombo);
-                    insertedWordIndexes[numLettersInfo.second.second] = true;
-                }
-                if(!insertedWordIndexes[numLettersInfo.second.first])
-                {
-                    keysPerWordSorted.emplace_back(firstListOfCombo);
-                    insertedWordIndexes[numLettersInfo.second.first] = true;
-                }
+                interrupted = true;
+                truncated = result.truncated;
+                unfinishedKeys = result.keys;
+                unfinishedSolutions = result.solutions;
+            }
+            else if (!checkpoint.completeShard(shard, result.keys, result.solutions, result.truncated, &error))
+            {
+                std::cerr << error << std::endl;
+            }
+            if (!options.quiet)
+            {
+                std::cout << "Shard " << shard + 1 << " of " << options.shards << (result.interrupted ? " stopped" : " done") << " after "
+                    << std::setprecision(3) << std::fixed << elapsedMs() << " ms, " << result.solutions << " full keys" << std::endl;
             }
         }
+        widened = !interrupted && startNextPass(options, checkpoint);
+    }
+    const size_t solutions = printShardKeys(options, checkpoint, unfinishedKeys, unfinishedSolutions, interrupted, truncated);
+    std::cout << solutions << " full keys from " << checkpoint.doneShards() << " of " << options.shards << " shards in "
+        << std::setprecision(3) << std::fixed << elapsedMs() << " ms" << std::endl;
+    const bool metricsWritten = options.metricsFile.empty()
+        || writeMetrics(options.metricsFile, totalMetrics, solver.dictionaryContext(), options.solver.candidateCache);
+    return metricsWritten ? 0 : 1;
+}
 
-        assert(keysPerWordSorted.size() == keysPerWord.size());
+// Batch and server mode always cache the word candidates in memory, a single solve only
+// when the cache is persisted or sized. The cache file does not have to exist yet.
+std::shared_ptr<CandidateCache> openCandidateCache(const CommandLineOptions& options)
+{
+    const bool manySolves = !options.batchInput.empty() || !options.serveSocket.empty() || !options.workerAddress.empty();
+    if (!manySolves && options.candidateCacheFile.empty() && options.candidateCacheMB == 0)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<CandidateCache> retVal = options.candidateCacheMB > 0
+        ? std::make_shared<CandidateCache>(options.candidateCacheMB) : std::make_shared<CandidateCache>();
+    std::string error;
+    if (!options.candidateCacheFile.empty() && std::ifstream(options.candidateCacheFile).is_open()
+        && !retVal->load(options.candidateCacheFile, &error))
+    {
+        std::cerr << "Ignoring the candidate cache: " << error << std::endl;
+    }
+    return retVal;
+}
+
+void closeCandidateCache(const CommandLineOptions& options)
+{
+    const std::shared_ptr<CandidateCache>& cache = options.solver.candidateCache;
+    if (!cache)
+    {
+        return;
+    }
+    const CandidateCacheStats stats = cache->stats();
+    std::cerr << "Candidate cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.patterns << " patterns in "
+        << stats.bytes / 1024 << " KB" << std::endl;
+    std::string error;
+    if (!options.candidateCacheFile.empty() && !cache->save(options.candidateCacheFile, &error))
+    {
+        std::cerr << error << std::endl;
+    }
+}
 
+// A single climb keeps its own state in the checkpoint, the enumeration modes and the
+// coordinator record finished shards. nullptr if --resume can not read the file.
+std::shared_ptr<SolveCheckpoint> openCheckpoint(const CommandLineOptions& options, size_t shardCount)
+{
+    std::shared_ptr<SolveCheckpoint> retVal = std::make_shared<SolveCheckpoint>(options.checkpointFile, options.cryptogram,
+        options.solver.mode, shardCount, static_cast<double>(options.checkpointIntervalMs));
+    std::string error;
+    if (options.resume && !retVal->resume(&error))
+    {
+        std::cerr << "Can not resume: " << error << std::endl;
+        return nullptr;
+    }
+    return retVal;
+}
 
-        //std::vector<std::thread> vecThreads;
-        //std::vector<std::future<CryptoKeyList>> vecFutures;
-        CryptoKeyList validKeys = combineKeysSmart(keysPerWord);
-        //for (size_t threadId = 0; threadId < maxThreads; ++threadId)
-        //{
-        //    std::packaged_task<CryptoKeyList(const std::vector<CryptoKeyList>&)> task(combineKeys);
-        //    vecFutures.emplace_back(task.get_future());
-        //    vecThreads.emplace_back(std::thread(std::move(task), keysPerWordSorted));
-        //}
-        //for (size_t threadId = 0; threadId < maxThreads; ++threadId)
-        //{
-        //    vecThreads[threadId].join();
-        //    CryptoKeyList threadResult = vecFutures[threadId].get();
-        //    threadResults.insert(threadResults.end(), threadResult.begin(), threadResult.end());
-        //}
-        
-        for(const CryptoKey& fullKey : validKeys)
+int main(int argc, char *argv[])
+{
+    CommandLineOptions options;
+    if (!parseCommandLine(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    options.solver.candidateCache = openCandidateCache(options);
+    if (!options.workerAddress.empty())
+    {
+        // the local workers share the stderr of the coordinator, the cache is only closed to save it
+        const int retVal = runWorker(options);
+        if (!options.candidateCacheFile.empty())
         {
-            printSolution(cryptogramTextFixed, fullKey, wordList);
+            closeCandidateCache(options);
         }
-#if OLD_IMPLEMENTATION
-        SolutionMap solutionMap;
-        std::uniform_int_distribution<unsigned int> dist(0, maxThreads - 1);
-        CryptoKeyData keyDataToPass;
+        return retVal;
+    }
+    if (!options.coordinateAddress.empty())
+    {
+        // without --checkpoint the shards are only merged in memory
+        std::shared_ptr<SolveCheckpoint> checkpoint = openCheckpoint(options, options.shards);
+        return checkpoint ? runCoordinator(options, *checkpoint, argc, argv) : 1;
+    }
+    const CpuTopology topology = options.pin ? getCpuTopology() : CpuTopology();
+    if (!options.serveSocket.empty())
+    {
+        setSolverLog(options.quiet ? nullptr : &std::cerr, options.logLevel);
+        const int retVal = runServer(options, topology);
+        closeCandidateCache(options);
+        return retVal;
+    }
 
-        while (solutionMap.size() < GOOD_SOLUTION_NUM)
-        {
-            std::vector<std::thread> vecThreads;
-            CryptoKeySet bestKeys = getBestKeys<ALPHABET_LETTERS_NUM>(solutionMap, maxThreads);
-            auto itBestKeys = bestKeys.begin();
-            auto itKeyToPass = bestKeys.begin();
-            std::mutex solutionMapLocker;
-            for (unsigned int thread = 0; thread < maxThreads; ++thread)
-            {
-                if (itBestKeys == bestKeys.end()) // exhausted the best keys
-                {
-                    unsigned int rnd = dist(e1);
+    setSolverLog(options.quiet ? nullptr : options.batchInput.empty() ? &std::cout : &std::cerr, options.logLevel);
+    if (!options.batchInput.empty())
+    {
+        std::shared_ptr<const NodeSolvers> solvers = loadNodeSolvers(options, topology);
+        const int retVal = solvers ? runBatch(options, *solvers, topology) : 1;
+        closeCandidateCache(options);
+        return retVal;
+    }
 
-                    itBestKeys = bestKeys.begin();
-                    int cntWalk = 0;
-                    for (itKeyToPass = bestKeys.begin(); itKeyToPass != bestKeys.end(); ++itKeyToPass) 
-                    {
-                        if (cntWalk == rnd)
-                        {
-                            break;
-                        }
-                        cntWalk++;
-                    }
-                }
-                else 
-                {
-                    itKeyToPass = itBestKeys;
-                }
-                keyDataToPass.first = *itKeyToPass;
-                keyDataToPass.second = 0;
-                vecThreads.push_back(
-                    std::thread(addOneBetterSolution, 
-                    std::ref(solutionMap), 
-                    std::ref(solutionMapLocker), 
-                    std::ref(keyDataToPass), 
-                    std::ref(cryptogramTextFixed), 
-                    std::ref(wordList),
-                    std::ref(freqMap)));
-                ++itKeyToPass;
-            }
+    std::string error;
+    std::shared_ptr<const DictionaryContext> dictionary = DictionaryContext::load(options.wordlists, false, &error);
+    if (!dictionary)
+    {
+        std::cerr << "Error loading the wordlists: " << error << std::endl;
+        return 1;
+    }
+    const Solver solver(dictionary);
+    if (!options.checkpointFile.empty())
+    {
+        const bool climb = isClimbMode(options.solver.mode);
+        if (options.solver.mode != SolverMode::Exhaustive)
+        {
+            // the shards of a beam or best-first search do not add up to the whole search
+            options.shards = 1;
+        }
+        std::shared_ptr<SolveCheckpoint> checkpoint = openCheckpoint(options, options.shards);
+        if (!checkpoint)
+        {
+            return 1;
+        }
+        if (!climb)
+        {
+            const int retVal = runCheckpointedSolve(options, solver, *checkpoint);
+            closeCandidateCache(options);
+            return retVal;
+        }
+        options.solver.checkpoint = checkpoint;
+    }
 
-            for (auto& thr : vecThreads) 
-            {
-                thr.join();
-            }
-            
+    //std::cout << "Enter cryptogram:" << std::endl;
+    //std::getline(std::cin, cryptogramText);
+    auto tpBegin = std::chrono::steady_clock::now();
+    size_t solutionNumber = 0;
+    // the solver log goes to the same stream, it is flushed first to keep the order
+    const SolverResult result = solver.solve(options.cryptogram, options.solver, [&](const RankedKey& key, double cost)
+    {
+        flushSolverLog();
+        auto microsecondsElapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpBegin).count();
+        std::cout << "Solution " << ++solutionNumber << " (cost " << std::setprecision(3) << std::fixed << cost
+            << ") after " << microsecondsElapsed / 1000.0 << " ms" << std::endl;
+        printSolution(key);
+    }, options.quiet ? ProgressHandler() : [&](const RankedKey& best)
+    {
+        flushSolverLog();
+        auto microsecondsElapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpBegin).count();
+        std::cout << "Best so far after " << std::setprecision(3) << std::fixed << microsecondsElapsed / 1000.0 << " ms, ";
+        printSolution(best);
+    });
+    flushSolverLog();
+    if (!result.error.empty())
+    {
+        std::cout << "Can not solve the cryptogram: " << result.error << std::endl;
+        return 1;
+    }
+    if (result.interrupted)
+    {
+        std::cout << "Stopped by the time limit, " << result.solutions << " full keys found" << std::endl;
+    }
+    if (result.truncated)
+    {
+        std::cout << "Key lists reached the memory limit, keys may be missing" << std::endl;
+    }
+    // best-first solutions were already printed as they were found
+    if (options.solver.mode != SolverMode::BestFirst || !result.solved())
+    {
+        for(const RankedKey& key : result.keys)
+        {
+            printSolution(key);
+        }
+        if (result.solutions > result.keys.size())
+        {
+            std::cout << "Best " << result.keys.size() << " of " << result.solutions << " keys shown" << std::endl;
         }
-#endif
     }
+    const bool metricsWritten = options.metricsFile.empty()
+        || writeMetrics(options.metricsFile, result.metrics, *dictionary, options.solver.candidateCache);
+    closeCandidateCache(options);
+    return metricsWritten ? 0 : 1;
 }
-
@@ -0,0 +1,182 @@
+#include <cmath>
+#include <limits>
+#include "solverengine.h"
+
+SegmentationIndex::SegmentationIndex(const WordList& wordList)
+{
+    // words by the reversed hash of every suffix, a word keeps the cost of its rank
+    std::array<std::unordered_map<uint64_t, float>, maxSegmentWordLength + 1> entries;
+    for(const WordList::value_type& entry : wordList)
+    {
+        const Word& word = entry.first;
+        const bool lettersOnly = std::all_of(word.c_str(), word.c_str() + word.size(), [](char chr) { return chr >= 'A' && chr <= 'Z'; });
+        if (!lettersOnly || word.size() == 0 || word.size() > maxSegmentWordLength
+            || (word.size() < 3 && entry.second >= maxSegmentShortWordRank[word.size()]))
+        {
+            continue;
+        }
+        uint64_t hash = startHash();
+        for(size_t length = 1; length <= word.size(); ++length)
+        {
+            hash = extendHash(hash, word.c_str()[word.size() - length]);
+            const float cost = length == word.size() ? static_cast<float>(std::log(entry.second + 2.0)) : std::numeric_limits<float>::infinity();
+            auto inserted = entries[length].emplace(hash, cost);
+            if (!inserted.second)
+            {
+                inserted.first->second = std::min(inserted.first->second, cost);
+            }
+        }
+    }
+    for(size_t length = 1; length <= maxSegmentWordLength; ++length)
+    {
+        Table& table = tables[length];
+        if (entries[length].empty())
+        {
+            continue;
+        }
+        size_t numSlots = 2;
+        table.shift = 63;
+        while (numSlots < entries[length].size() * 2)
+        {
+            numSlots *= 2;
+            --table.shift;
+        }
+        table.slots.resize(numSlots);
+        for(const auto& entry : entries[length])
+        {
+            size_t slot = (entry.first * 0x9E3779B97F4A7C15ull) >> table.shift;
+            while (table.slots[slot].hash != 0)
+            {
+                slot = (slot + 1) & (numSlots - 1);
+            }
+            table.slots[slot].hash = entry.first;
+            table.slots[slot].cost = entry.second;
+        }
+    }
+}
+
+const SegmentationIndex& getSegmentationIndex(const DictionaryTier& tier)
+{
+    std::call_once(tier.segmentationOnce, [&]()
+    {
+        const auto tpBegin = std::chrono::steady_clock::now();
+        tier.segmentation.reset(new SegmentationIndex(tier.wordList));
+        logMessage(LogLevel::Info, "Segmentation index of {} built in {:.3} ms\n", tier.fileName, getElapsedMs(tpBegin));
+    });
+    return *tier.segmentation;
+}
+
+// Every prefix takes the best of leaving its last letter uncovered and of a word ending
+// there, found by reading backwards until no word ends with the letters read
+void segmentText(TextView text, size_t offset, const SegmentationIndex& index, std::vector<double>& values,
+                 std::vector<uint32_t>& covered, std::vector<uint8_t>* outLengths)
+{
+    values.resize(text.size() + 1);
+    covered.resize(text.size() + 1);
+    if (outLengths)
+    {
+        outLengths->resize(text.size() + 1);
+    }
+    if (offset == 0)
+    {
+        values[0] = 0.0;
+        covered[0] = 0;
+    }
+    const char* letters = text.data();
+    for(size_t end = offset + 1; end <= text.size(); ++end)
+    {
+        double bestValue = values[end - 1];
+        uint32_t bestCovered = covered[end - 1];
+        size_t bestLength = 0;
+        uint64_t hash = SegmentationIndex::startHash();
+        const size_t maxLength = std::min(end, maxSegmentWordLength);
+        for(size_t length = 1; length <= maxLength; ++length)
+        {
+            hash = SegmentationIndex::extendHash(hash, letters[end - length]);
+            const SegmentationIndex::Entry* entry = index.find(length, hash);
+            if (!entry)
+            {
+                break;
+            }
+            const double value = values[end - length] + length * segmentLetterValue - entry->cost;
+            if (value > bestValue)
+            {
+                bestValue = value;
+                bestCovered = covered[end - length] + static_cast<uint32_t>(length);
+                bestLength = length;
+            }
+        }
+        values[end] = bestValue;
+        covered[end] = bestCovered;
+        if (outLengths)
+        {
+            (*outLengths)[end] = static_cast<uint8_t>(bestLength);
+        }
+    }
+}
+
+// The share of the covered letters less the cost of the words, so of two keys covering as
+// much the one with more frequent words wins. Never 1.0, every word costs something.
+double getSegmentationQuality(size_t length, double value)
+{
+    return length == 0 ? 0.0 : value / (length * segmentLetterValue);
+}
+
+bool isSegmentationSolved(size_t length, uint32_t covered, double value)
+{
+    return length >= minSolvedSegmentLetters && covered == length && value >= length * (segmentLetterValue - maxSolvedSegmentCost);
+}
+
+// Uncovered letters in a row stay together between the words
+std::string getSegmentedText(TextView text, const SegmentationIndex& index, double* outQuality, bool* outSolved)
+{
+    std::vector<double> values;
+    std::vector<uint32_t> covered;
+    std::vector<uint8_t> lengths;
+    segmentText(text, 0, index, values, covered, &lengths);
+    std::vector<TextView> parts;
+    for(size_t end = text.size(); end > 0; )
+    {
+        size_t begin = end - std::max<size_t>(1, lengths[end]);
+        while (lengths[end] == 0 && begin > 0 && lengths[begin] == 0)
+        {
+            --begin;
+        }
+        parts.emplace_back(text.substr(begin, end - begin));
+        end = begin;
+    }
+    std::string retVal;
+    for(auto it = parts.rbegin(); it != parts.rend(); ++it)
+    {
+        retVal.append(retVal.empty() ? "" : " ").append(it->data(), it->size());
+    }
+    if (outQuality)
+    {
+        *outQuality = getSegmentationQuality(text.size(), values.back());
+    }
+    if (outSolved)
+    {
+        *outSolved = isSegmentationSolved(text.size(), covered.back(), values.back());
+    }
+    return retVal;
+}
+
+double SegmentationScorer::resegment(TextView text)
+{
+    size_t offset = 0;
+    if (lastText.size() == text.size())
+    {
+        const char* letters = text.data();
+        offset = std::mismatch(letters, letters + text.size(), lastText.begin()).first - letters;
+        std::copy(letters + offset, letters + text.size(), lastText.begin() + offset);
+    }
+    else
+    {
+        lastText.assign(text.data(), text.size());
+    }
+    if (offset < text.size() || values.empty())
+    {
+        segmentText(text, offset, index, values, covered);
+    }
+    return getSegmentationQuality(text.size(), values.back());
+}
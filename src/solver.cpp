@@ -0,0 +1,257 @@
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include "solverengine.h"
+
+struct DictionaryContext::Tiers
+{
+    Dictionary dictionary;
+};
+
+DictionaryContext::DictionaryContext() : tiers(new Tiers())
+{
+}
+
+DictionaryContext::~DictionaryContext()
+{
+}
+
+std::shared_ptr<const DictionaryContext> DictionaryContext::load(const std::vector<std::string>& wordlists, bool preloadAllTiers,
+                                                                 std::string* outError)
+{
+    if (wordlists.empty())
+    {
+        if (outError)
+        {
+            *outError = "no wordlist given";
+        }
+        return nullptr;
+    }
+    for(const std::string& fileName : wordlists)
+    {
+        if (!std::ifstream(fileName).is_open())
+        {
+            if (outError)
+            {
+                *outError = "error opening wordlist " + fileName;
+            }
+            return nullptr;
+        }
+    }
+    std::shared_ptr<DictionaryContext> retVal(new DictionaryContext());
+    retVal->tiers->dictionary = createDictionary(wordlists);
+    loadDictionaryTier(retVal->tiers->dictionary, preloadAllTiers ? wordlists.size() - 1 : 0);
+    return retVal;
+}
+
+size_t DictionaryContext::tierCount() const
+{
+    return tiers->dictionary.size();
+}
+
+const std::string& DictionaryContext::tierFileName(size_t tier) const
+{
+    return tiers->dictionary.at(tier)->fileName;
+}
+
+std::vector<DictionaryTierMetrics> DictionaryContext::tierMetrics() const
+{
+    std::vector<DictionaryTierMetrics> retVal;
+    for(const std::unique_ptr<DictionaryTier>& tier : tiers->dictionary)
+    {
+        DictionaryTierMetrics metrics;
+        metrics.fileName = tier->fileName;
+        // a tier still loading by another thread is reported as not loaded
+        metrics.loaded = tier->loaded;
+        if (metrics.loaded)
+        {
+            metrics.words = tier->wordList.size();
+            metrics.loadMs = tier->loadMs;
+            metrics.patternMapMs = tier->patternMapMs;
+        }
+        retVal.emplace_back(metrics);
+    }
+    return retVal;
+}
+
+void SolverMetrics::merge(const SolverMetrics& other)
+{
+    solves += other.solves;
+    candidateMs += other.candidateMs;
+    searchMs += other.searchMs;
+    rankMs += other.rankMs;
+    candidateWords += other.candidateWords;
+    joinSteps += other.joinSteps;
+    prunedKeys += other.prunedKeys;
+    scoringCalls += other.scoringCalls;
+    mutations += other.mutations;
+    climbMs += other.climbMs;
+    seenKeyChecks += other.seenKeyChecks;
+    seenKeyHits += other.seenKeyHits;
+}
+
+Solver::Solver(std::shared_ptr<const DictionaryContext> dictionary) : dictionary(std::move(dictionary))
+{
+}
+
+// Canonical unique keys with their quality, the best first
+template<TextSizeClass SizeClass, typename Scorer>
+std::vector<ScoredKey> rankKeys(TextView cryptoText, CryptoKeyList& keys, const DictionaryTier& tier)
+{
+    std::vector<ScoredKey> retVal;
+    const ActiveLetters activeLetters = getActiveLetters(cryptoText);
+    TextBuffer<SizeClass> decrypted(cryptoText.size());
+    Scorer scorer(tier);
+    CryptoKeySet uniqueKeys;
+    for(CryptoKey& key : keys)
+    {
+        canonicalizeKey(key, activeLetters);
+        if (uniqueKeys.insert(key).second)
+        {
+            retVal.emplace_back(scorer.score(cryptoText, key, decrypted), key);
+        }
+    }
+    std::stable_sort(retVal.begin(), retVal.end(), ScoredKeyGreater());
+    return retVal;
+}
+
+// The memory limit bounds the key lists of this call only, callers running solves in
+// parallel split their budget between them. When the time limit or the cancellation stops
+// the search before it found a full key, the best partial key so far is the result. A
+// patristocrat is solved on its letters alone, the keys decode them with the word breaks
+// of their best segmentation.
+SolverResult Solver::solve(const std::string& ciphertext, const SolverOptions& options, const SolutionHandler& onSolution,
+                           const ProgressHandler& onProgress) const
+{
+    SolverResult retVal;
+    std::string text = ciphertext;
+    std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+    const bool patristocrat = options.mode == SolverMode::Patristocrat;
+    if (patristocrat)
+    {
+        text.erase(std::remove_if(text.begin(), text.end(), [](char chr) { return !isCipherLetter(chr); }), text.end());
+        if (!options.cribs.empty())
+        {
+            retVal.error = "cribs need word breaks";
+            return retVal;
+        }
+    }
+    if (!isSupportedCryptogram(text))
+    {
+        retVal.error = "no word to decrypt";
+        return retVal;
+    }
+    if (options.shardIndex >= options.shardCount)
+    {
+        retVal.error = "shard index out of range";
+        return retVal;
+    }
+
+    auto tpBegin = std::chrono::steady_clock::now();
+    const Dictionary& tiers = dictionary->tiers->dictionary;
+    const TextView cryptoText = text;
+    CryptoKeyList rootKeys;
+    if (!getRootKeys(cryptoText, options, rootKeys, retVal.error))
+    {
+        return retVal;
+    }
+    const size_t maxKeys = std::max<size_t>(1, options.memoryLimitMB * 1024 * 1024 / sizeof(ScoredKey));
+    auto toRankedKey = [&](const CryptoKey& key, const DictionaryTier& tier) -> RankedKey
+    {
+        RankedKey rankedKey;
+        const CryptoText plaintext = transformText<ALPHABET_LETTERS_NUM>(cryptoText, key);
+        rankedKey.key = key.c_str();
+        if (patristocrat)
+        {
+            rankedKey.plaintext = getSegmentedText(plaintext, getSegmentationIndex(tier), &rankedKey.quality);
+        }
+        else
+        {
+            rankedKey.plaintext = plaintext.c_str();
+            rankedKey.quality = calcTextQuality(plaintext, tier.wordList);
+        }
+        return rankedKey;
+    };
+    const ActiveLetters activeLetters = getActiveLetters(cryptoText);
+    SolutionCallback onKey;
+    if (onSolution)
+    {
+        // searchKeysInTiers sets the tier of a pass before it starts searching
+        onKey = [&](const CryptoKey& key, double cost)
+        {
+            CryptoKey canonicalKey = key;
+            canonicalizeKey(canonicalKey, activeLetters);
+            onSolution(toRankedKey(canonicalKey, *tiers[retVal.dictionaryTier]), cost);
+        };
+    }
+
+    SearchControl::ImprovementCallback onImprovement;
+    if (onProgress)
+    {
+        onImprovement = [&](const CryptoKey& key, double quality)
+        {
+            CryptoKey canonicalKey = key;
+            canonicalizeKey(canonicalKey, activeLetters);
+            RankedKey rankedKey;
+            rankedKey.key = canonicalKey.c_str();
+            rankedKey.plaintext = transformText<ALPHABET_LETTERS_NUM>(cryptoText, canonicalKey).c_str();
+            if (patristocrat)
+            {
+                rankedKey.plaintext = getSegmentedText(rankedKey.plaintext, getSegmentationIndex(*tiers[retVal.dictionaryTier]));
+            }
+            rankedKey.quality = quality;
+            onProgress(rankedKey);
+        };
+    }
+    SearchControl control(options, cryptoText, onImprovement);
+    if (options.candidateCache)
+    {
+        control.setCandidateCache(options.candidateCache->cache.get());
+    }
+    if (options.checkpoint)
+    {
+        control.setCheckpoint(options.checkpoint->store.get());
+    }
+
+    auto tpSearch = std::chrono::steady_clock::now();
+    CryptoKeyList validKeys = searchKeysInTiers(cryptoText, tiers, options, rootKeys, maxKeys, onKey, control, retVal.dictionaryTier,
+                                                retVal.hasNextPass, retVal.nextPass);
+    SolverMetrics& metrics = control.getMetrics();
+    metrics.searchMs = std::max(0.0, getElapsedMs(tpSearch) - metrics.candidateMs);
+
+    retVal.interrupted = control.isStopped();
+    retVal.truncated = control.isTruncated();
+    const bool bestSoFarOnly = validKeys.empty() && retVal.interrupted && control.hasBestKey();
+    if (bestSoFarOnly)
+    {
+        validKeys.emplace_back(control.getBestKey());
+    }
+    const auto tpRank = std::chrono::steady_clock::now();
+    const DictionaryTier& tier = *tiers[retVal.dictionaryTier];
+    const bool shortText = getTextSizeClass(cryptoText.size()) == TextSizeClass::Short;
+    std::vector<ScoredKey> scoredKeys = patristocrat
+        ? (shortText ? rankKeys<TextSizeClass::Short, SegmentationScorer>(cryptoText, validKeys, tier)
+                     : rankKeys<TextSizeClass::Long, SegmentationScorer>(cryptoText, validKeys, tier))
+        : (shortText ? rankKeys<TextSizeClass::Short, WordQualityScorer>(cryptoText, validKeys, tier)
+                     : rankKeys<TextSizeClass::Long, WordQualityScorer>(cryptoText, validKeys, tier));
+    const size_t uniqueKeys = scoredKeys.size();
+    if (scoredKeys.size() > options.maxSolutions)
+    {
+        scoredKeys.resize(options.maxSolutions);
+    }
+    retVal.solutions = bestSoFarOnly ? 0 : uniqueKeys;
+    for(const ScoredKey& scoredKey : scoredKeys)
+    {
+        retVal.keys.emplace_back(toRankedKey(scoredKey.second, tier));
+    }
+    if (!scoredKeys.empty())
+    {
+        control.offer(scoredKeys.front().second, scoredKeys.front().first);
+    }
+    metrics.rankMs = getElapsedMs(tpRank);
+    metrics.scoringCalls += uniqueKeys;
+    metrics.solves = 1;
+    retVal.metrics = std::move(metrics);
+    retVal.solveMs = getElapsedMs(tpBegin);
+    return retVal;
+}
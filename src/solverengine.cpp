@@ -0,0 +1,2495 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <queue>
+#include <cmath>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "solverengine.h"
+
+SearchControl::SearchControl(const SolverOptions& options, TextView text, ImprovementCallback onImprovement)
+    : cancellation(options.cancellation), text(text), onImprovement(std::move(onImprovement))
+{
+    double timeLimitMs = options.timeLimitMs;
+    if (timeLimitMs <= 0 && options.mode == SolverMode::Patristocrat && text.size() < minSolvedSegmentLetters)
+    {
+        // the climb would never stop by itself
+        timeLimitMs = unsolvedSegmentTimeLimitMs;
+    }
+    if (timeLimitMs > 0)
+    {
+        hasDeadline = true;
+        deadline = std::chrono::steady_clock::now()
+            + std::chrono::microseconds(static_cast<long long>(timeLimitMs * 1000.0));
+    }
+    // a solve that starts after its deadline or cancellation does no work at all
+    pollCount = checkInterval - 1;
+    shouldStop();
+}
+
+void SearchControl::offer(const CryptoKey& key)
+{
+    if (wordList)
+    {
+        offer(key, calcTextQuality(transformText<ALPHABET_LETTERS_NUM>(text, key), *wordList));
+    }
+}
+
+void SearchControl::offer(const CryptoKey& key, double quality)
+{
+    if (quality > bestQuality)
+    {
+        bestQuality = quality;
+        bestKey = key;
+        if (onImprovement)
+        {
+            onImprovement(key, quality);
+        }
+    }
+}
+
+// Letters get codes in the order of their first occurrence, other characters like the
+// apostrophe stay as they are. Words longer than maxWordLength get a cut pattern, they can
+// not be in the dictionary anyway.
+Word getWordPattern(TextView word)
+{
+
+    Word retVal;
+    Word listOfUsedLetters;
+    char code = 'A';
+    for(size_t index = 0; index < std::min<size_t>(word.size(), maxWordLength); ++index)
+    {
+        const char& chr = word.at(index);
+        if (!isCipherLetter(chr))
+        {
+            retVal.push_back(chr);
+            listOfUsedLetters.push_back(chr);
+            continue;
+        }
+        size_t pos = listOfUsedLetters.find_first_of(chr);
+        if(pos == Word::npos)
+        {
+            retVal.push_back(code);
+            listOfUsedLetters.push_back(chr);
+            code++;
+        }
+        else
+        {
+            retVal.push_back(retVal.at(pos));
+        }
+    }
+    return retVal;
+}
+
+LetterPositions getWordLetterPositions(TextView word)
+{
+    LetterPositions retVal;
+    for(size_t index = 0; index < word.size(); ++index)
+    {
+        if (!isCipherLetter(word.at(index)))
+        {
+            continue;
+        }
+        const unsigned int position = word.at(index) - 'A';
+        if (std::find(retVal.begin(), retVal.end(), position) == retVal.end())
+        {
+            retVal.emplace_back(position);
+        }
+    }
+    return retVal;
+}
+
+WordPatternMap createPatternMap(WordList& list)
+{
+    WordPatternMap retVal;
+    for(const WordList::value_type& entry : list)
+    {
+        Word pattern = getWordPattern(entry.first);
+        WordList& wordListOfCurrentPattern = retVal[pattern];
+        wordListOfCurrentPattern.emplace(entry.first, entry.second);
+    }
+    return retVal;
+}
+
+CryptoKey getInitialKey()
+{
+    return CryptoKey("**************************");
+}
+
+ActiveLetters getActiveLetters(TextView text)
+{
+    ActiveLetters retVal;
+    retVal.present.fill(false);
+    for(size_t index = 0; index < text.size(); ++index)
+    {
+        const char& chr = text.at(index);
+        if (chr >= 'A' && chr <= 'Z')
+        {
+            retVal.present[chr - 'A'] = true;
+        }
+    }
+    for(unsigned int index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+    {
+        if(retVal.present[index])
+        {
+            retVal.positions.emplace_back(index);
+        }
+    }
+    retVal.fixedKey = getInitialKey();
+    return retVal;
+}
+
+// Letters of rootKey that occur in the text are fixed: they are no longer mutated and
+// every random key gets them
+void fixLetters(ActiveLetters& activeLetters, const CryptoKey& rootKey)
+{
+    std::vector<unsigned int> positions;
+    for(unsigned int position : activeLetters.positions)
+    {
+        if (rootKey.at(position) == '*')
+        {
+            positions.emplace_back(position);
+        }
+        else
+        {
+            activeLetters.fixedKey.at(position) = rootKey.at(position);
+        }
+    }
+    activeLetters.positions.swap(positions);
+}
+
+// Bring the key to the canonical representative of its projection on the active letters.
+// Partial keys get '*' on every inactive position, full keys get the plain letters
+// not used by the letters of the text in ascending order.
+void canonicalizeKey(CryptoKey& key, const ActiveLetters& activeLetters)
+{
+    if (key.size() != ALPHABET_LETTERS_NUM)
+    {
+        return;
+    }
+    if (key.find_first_of('*') != CryptoKey::npos)
+    {
+        for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+        {
+            if(!activeLetters.present[index])
+            {
+                key.at(index) = '*';
+            }
+        }
+    }
+    else
+    {
+        std::array<bool, ALPHABET_LETTERS_NUM> usedLetters;
+        usedLetters.fill(false);
+        for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+        {
+            const char& chr = key.at(index);
+            if (activeLetters.present[index] && chr >= 'A' && chr <= 'Z')
+            {
+                usedLetters[chr - 'A'] = true;
+            }
+        }
+        char nextFree = 'A';
+        for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+        {
+            if(!activeLetters.present[index])
+            {
+                while (usedLetters[nextFree - 'A'])
+                {
+                    ++nextFree;
+                }
+                key.at(index) = nextFree;
+                ++nextFree;
+            }
+        }
+    }
+}
+
+CryptoKey getCommonKeyFromTwoWords(TextView encryptedWord, const Word& decryptedWord)
+{
+    CryptoKey retVal = getInitialKey();
+    assert(encryptedWord.size() == decryptedWord.size());
+    for(size_t index = 0; index < encryptedWord.size(); ++index)
+    {
+        const char& chrEnc = encryptedWord.at(index);
+        const char& chrDec = decryptedWord.at(index);
+        if (isCipherLetter(chrEnc))
+        {
+            retVal.at(chrEnc - 'A') = chrDec;
+        }
+    }
+    return retVal;
+}
+
+// Keys of all dictionary words matching the encrypted word, the most frequent word first.
+// outRanks receives the rank of the word behind each key.
+CryptoKeyList getMatchingKeys(TextView encryptedWord, const WordList& possibleMatches, WordRankList& outRanks)
+{
+    CryptoKeyList retVal;
+    std::vector<const WordList::value_type*> sortedMatches;
+    sortedMatches.reserve(possibleMatches.size());
+
+    for(const WordList::value_type& entry : possibleMatches)
+    {
+        const Word& matchingWord = entry.first;
+        bool matches = matchingWord.size() == encryptedWord.size();
+        for(size_t index = 0; matches && index < matchingWord.size(); ++index)
+        {
+            // a substitution maps letters to letters, the apostrophe of "'EM" stays in place
+            const char& chr = matchingWord.at(index);
+            matches = isCipherLetter(chr) ? isCipherLetter(encryptedWord.at(index)) : chr == encryptedWord.at(index);
+        }
+        if (matches)
+        {
+            sortedMatches.emplace_back(&entry);
+        }
+    }
+    std::sort(sortedMatches.begin(), sortedMatches.end(),
+              [](const WordList::value_type* entry1, const WordList::value_type* entry2) -> bool
+    {
+        return entry1->second < entry2->second;
+    });
+
+    retVal.reserve(sortedMatches.size());
+    outRanks.clear();
+    outRanks.reserve(sortedMatches.size());
+    for(const WordList::value_type* entry : sortedMatches)
+    {
+        retVal.emplace_back(getCommonKeyFromTwoWords(encryptedWord, entry->first));
+        outRanks.emplace_back(entry->second);
+    }
+
+    return retVal;
+}
+
+// Candidates of all words of the tier with the pattern, from cache if it has them
+std::shared_ptr<const PatternCandidates> getPatternCandidates(const DictionaryTier& tier, const Word& pattern, PatternCandidateCache* cache)
+{
+    std::shared_ptr<const PatternCandidates> retVal = cache ? cache->find(tier.version, pattern) : nullptr;
+    if (!retVal)
+    {
+        std::shared_ptr<PatternCandidates> candidates = std::make_shared<PatternCandidates>();
+        WordPatternMap::const_iterator it = tier.patternMap.find(pattern);
+        if (it != tier.patternMap.end())
+        {
+            // the pattern is a word of its own letters, so its keys are in those letters
+            candidates->keys = getMatchingKeys(pattern, it->second, candidates->ranks);
+        }
+        if (cache)
+        {
+            cache->insert(tier.version, pattern, candidates);
+        }
+        retVal = candidates;
+    }
+    return retVal;
+}
+
+// Keys of encryptedWord from the keys of its pattern, pattern letters become the cipher
+// letters at the same positions
+CryptoKeyList translatePatternKeys(TextView encryptedWord, const Word& pattern, const CryptoKeyList& patternKeys)
+{
+    CryptoKeyList retVal;
+    std::array<char, ALPHABET_LETTERS_NUM> cipherLetters;
+    size_t numLetters = 0;
+    for(size_t index = 0; index < pattern.size(); ++index)
+    {
+        const char& chr = pattern.at(index);
+        if (isCipherLetter(chr) && static_cast<size_t>(chr - 'A') == numLetters)
+        {
+            cipherLetters[numLetters++] = encryptedWord.at(index);
+        }
+    }
+    retVal.reserve(patternKeys.size());
+    for(const CryptoKey& patternKey : patternKeys)
+    {
+        CryptoKey key = getInitialKey();
+        for(size_t letter = 0; letter < numLetters; ++letter)
+        {
+            key.at(cipherLetters[letter] - 'A') = patternKey.at(letter);
+        }
+        retVal.emplace_back(key);
+    }
+    return retVal;
+}
+
+// Merge two partial keys into outKey, fails if they assign different plain letters
+// to the same cipher letter or the same plain letter to two cipher letters
+inline bool mergeTwoKeys(const CryptoKey& key1, const CryptoKey& key2, CryptoKey& outKey)
+{
+    uint32_t usedLetters = 0;
+    for (size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+    {
+        const char& chr1 = key1.at(index);
+        const char& chr2 = key2.at(index);
+        char chrOut = '*';
+        if ((chr1 != '*') && (chr2 != '*'))
+        {
+            if (chr1 != chr2)
+            {
+                return false;
+            }
+            chrOut = chr1;
+        }
+        else if (chr1 != '*')
+        {
+            chrOut = chr1;
+        }
+        else if (chr2 != '*')
+        {
+            chrOut = chr2;
+        }
+        if (chrOut != '*')
+        {
+            const uint32_t letterBit = 1u << (chrOut - 'A');
+            if (usedLetters & letterBit)
+            {
+                return false;
+            }
+            usedLetters |= letterBit;
+        }
+        outKey.at(index) = chrOut;
+    }
+    return true;
+}
+
+CryptoKeyList combineTwoKeys(const CryptoKey& key1, const CryptoKey& key2, bool keepBadResults)
+{
+    CryptoKeyList list;
+    CryptoKey outKey(getInitialKey());
+    if (mergeTwoKeys(key1, key2, outKey))
+    {
+        list.emplace_back(outKey);
+    }
+    else if(keepBadResults)
+    {
+        list.emplace_back(key1);
+        list.emplace_back(key2);
+    }
+    return list;
+}
+
+// Join every key of the first list with every key of the second. When maxKeys is reached
+// the join stops and outTruncated is set, so a too large join degrades instead of
+// exhausting the memory. A stopped control ends the join early as well.
+CryptoKeyList combineTwoKeyLists(const CryptoKeyList& keyList1, const CryptoKeyList& keyList2, size_t maxKeys, bool& outTruncated,
+                                 SearchControl* control)
+{
+    CryptoKeyList retVal;
+    CryptoKeyList::const_iterator it1;
+    CryptoKeyList::const_iterator it2;
+    CryptoKey outKey(getInitialKey());
+
+    for (it1 = keyList1.begin(); it1 != keyList1.end(); ++it1)
+    {
+        if (control && control->shouldStop())
+        {
+            break;
+        }
+        for (it2 = keyList2.begin(); it2 != keyList2.end(); ++it2) 
+        {
+            if (mergeTwoKeys(*it1, *it2, outKey))
+            {
+                if (retVal.size() >= maxKeys)
+                {
+                    outTruncated = true;
+                    return retVal;
+                }
+                retVal.emplace_back(outKey);
+            }
+        }
+    }
+    return retVal;
+}
+
+CryptoKeyList combineTwoKeyLists(const CryptoKeyList& keyList1, const CryptoKeyList& keyList2)
+{
+    bool truncated = false;
+    return combineTwoKeyLists(keyList1, keyList2, std::numeric_limits<size_t>::max(), truncated);
+}
+
+int getNumberOfCommonLetterAssigments(const CryptoKey& key1, const CryptoKey& key2)
+{
+    int retVal = 0;
+    for(auto index = 0; index < key1.size(); ++index)
+    {
+        if((key1.at(index) != '*') && (key2.at(index) != '*'))
+        {
+            retVal++;
+        }
+    }
+    return retVal;
+}
+
+CryptoKeyList combineKeysSuccessOnly(const std::vector<CryptoKeyList>& keyLists, const CombinationList& comboList)
+{
+    CryptoKeyList retVal;
+//    std::vector<CryptoKeyList::const_iterator> vecKeyListIterators;
+//    for(const auto& list : keyLists)
+//    {
+//        keyListIterators.emplace_back(list.begin());
+//    }
+//    int index1 = 0;
+//    int index2 = 1;
+//    int currentCycle;
+//    while(vecKeyListIterators.back() != keyLists.back().end())
+//    {
+//        CryptoKeyList::const_iterator& iterator1 = vecKeyListIterators[index1];
+//
+//        while(index2 < vecKeyListIterators.size())
+//        {
+//            CryptoKeyList::const_iterator& iterator2 = vecKeyListIterators[index2];
+//        }
+//    }
+
+
+    return retVal;
+}
+
+// Keys of a join that was stopped before its last word are partial, they only reach the
+// control as the best key so far
+CryptoKeyList combineKeys(const std::vector<CryptoKeyList>& keyList, const CombinationList& comboList, size_t maxKeys,
+                          SearchControl* control)
+{
+    CryptoKeyList retVal;
+
+    for (const Combination& combo : comboList)
+    {
+        if (combo.empty())
+        {
+            continue;
+        }
+        CryptoKeyList currentList;
+        currentList = keyList[combo[0]];
+        bool truncated = false;
+        for (int index = 1; index < combo.size(); ++index) 
+        {
+            const CryptoKeyList& keyListOther = keyList[combo[index]];
+            logMessage(LogLevel::Info, "Combining key lists with size {} and {}\n", currentList.size(), keyListOther.size());
+            currentList = combineTwoKeyLists(currentList, keyListOther, maxKeys, truncated, control);
+            logMessage(LogLevel::Info, "New key list: {}\n", currentList.size());
+            if (truncated)
+            {
+                logMessage(LogLevel::Info, "Key list reached the memory limit of {} keys, the result is incomplete\n", maxKeys);
+                truncated = false;
+                if (control)
+                {
+                    control->markTruncated();
+                }
+            }
+            if (control && !currentList.empty())
+            {
+                control->offer(currentList.front());
+            }
+            if (control && control->isStopped())
+            {
+                logMessage(LogLevel::Info, "Join stopped after {} of {} words\n", index + 1, combo.size());
+                if (index + 1 < combo.size())
+                {
+                    currentList.clear();
+                }
+                break;
+            }
+        }
+        retVal.insert(retVal.end(), currentList.begin(), currentList.end());
+        if (control && control->isStopped())
+        {
+            break;
+        }
+    }
+    return retVal;
+}
+
+int getNumberOfCommonLetters(const LetterPositions& positions1, const LetterPositions& positions2)
+{
+    int retVal = 0;
+    for(unsigned int position : positions1)
+    {
+        if (std::find(positions2.begin(), positions2.end(), position) != positions2.end())
+        {
+            retVal++;
+        }
+    }
+    return retVal;
+}
+
+// Order the words so that pairs sharing the most cipher letters are joined first
+// (the join with the most constraints prunes the most), ties go to the smaller key list.
+// Wildcard words are left out of the order.
+Combination planWordOrder(const CryptogramWords& cryptogram)
+{
+    using TwoWordCombo = std::pair<int, int>;
+    using NumberOfLetterPerTwoWords = std::pair<int, TwoWordCombo>;
+    const std::vector<CryptoKeyList>& keysPerWord = cryptogram.keysPerWord;
+    std::vector<NumberOfLetterPerTwoWords> numCommonLetters;
+    size_t numWords = cryptogram.numWords;
+    Combination retVal;
+    retVal.reserve(numWords);
+
+    std::vector<int> joinedWordIndexes;
+    for(size_t index = 0; index < numWords; ++index)
+    {
+        if (!cryptogram.wildcardWords[index])
+        {
+            joinedWordIndexes.emplace_back(index);
+        }
+    }
+
+    for(size_t index1 = 0; index1 + 1 < joinedWordIndexes.size(); ++index1)
+    {
+        for(size_t index2 = index1 + 1; index2 < joinedWordIndexes.size(); ++index2)
+        {
+            const int word1 = joinedWordIndexes[index1];
+            const int word2 = joinedWordIndexes[index2];
+            int letters = getNumberOfCommonLetters(cryptogram.positionsPerWord[word1], cryptogram.positionsPerWord[word2]);
+            numCommonLetters.emplace_back(letters, TwoWordCombo(word1, word2));
+        }
+    }
+
+    std::sort(numCommonLetters.begin(), numCommonLetters.end(),
+              [&](const NumberOfLetterPerTwoWords& pair1, const NumberOfLetterPerTwoWords& pair2) ->bool
+    {
+        bool retVal = false;
+        if(pair1.first > pair2.first)
+        {
+            retVal = true;
+        }
+        else if(pair1.first == pair2.first)
+        {
+            if(std::min(keysPerWord[pair1.second.first].size(), keysPerWord[pair1.second.second].size())
+                    <
+               std::min(keysPerWord[pair2.second.first].size(), keysPerWord[pair2.second.second].size()))
+            {
+                retVal = true;
+            }
+        }
+        return retVal;
+    });
+
+    std::vector<bool> insertedWordIndexes;
+    insertedWordIndexes.resize(numWords, false);
+    for(const NumberOfLetterPerTwoWords& numLettersInfo : numCommonLetters)
+    {
+        int first = numLettersInfo.second.first;
+        int second = numLettersInfo.second.second;
+        if(keysPerWord[first].size() >= keysPerWord[second].size())
+        {
+            std::swap(first, second);
+        }
+        if(!insertedWordIndexes[first])
+        {
+            retVal.emplace_back(first);
+            insertedWordIndexes[first] = true;
+        }
+        if(!insertedWordIndexes[second])
+        {
+            retVal.emplace_back(second);
+            insertedWordIndexes[second] = true;
+        }
+    }
+    if(joinedWordIndexes.size() == 1)
+    {
+        retVal.emplace_back(joinedWordIndexes[0]);
+    }
+
+    assert(retVal.size() == joinedWordIndexes.size());
+    return retVal;
+}
+
+// Partial keys that behave the same in every later join: equal on the cipher letters of
+// the words still to be joined and using the same set of plain letters. Every origin is
+// a way to reach the group, the group of the previous word and the candidate of this word.
+struct ProjectedGroup
+{
+    CryptoKey key;
+    uint32_t usedPlainLetters;
+    std::vector<std::pair<uint32_t, uint32_t>> origins;
+    size_t numKeys;             // full partial keys in the group, saturated at the key limit
+};
+
+struct ProjectedGroupHasher
+{
+    size_t operator()(const std::pair<CryptoKey, uint32_t>& projection) const
+    {
+        return CryptoKey::hasher()(projection.first) ^ (projection.second * 0x9E3779B1u);
+    }
+};
+
+using ProjectedGroupIndex = std::unordered_map<std::pair<CryptoKey, uint32_t>, uint32_t, ProjectedGroupHasher>;
+
+// One entry of ProjectedGroupIndex: the value, the next pointer and the cached hash
+constexpr size_t projectedIndexNodeBytes = sizeof(ProjectedGroupIndex::value_type) + sizeof(void*) + sizeof(size_t);
+
+// Bytes a push_back adds to vector, which doubles its capacity when it is full
+template<typename T>
+size_t getGrowthBytes(const std::vector<T>& vector)
+{
+    return vector.size() < vector.capacity() ? 0 : std::max<size_t>(1, vector.capacity()) * sizeof(T);
+}
+
+uint32_t getLetterMask(const LetterPositions& positions)
+{
+    uint32_t retVal = 0;
+    for(unsigned int position : positions)
+    {
+        retVal |= 1u << position;
+    }
+    return retVal;
+}
+
+// Assign the letters of the word in candidate to key, which holds usedPlainLetters.
+// Letters of candidate outside of the word (known letters) are in every key already.
+inline bool extendProjectedKey(const CryptoKey& key, uint32_t usedPlainLetters, const CryptoKey& candidate, const LetterPositions& wordLetters,
+                               CryptoKey& outKey, uint32_t& outUsedPlainLetters)
+{
+    outKey = key;
+    outUsedPlainLetters = usedPlainLetters;
+    for(unsigned int position : wordLetters)
+    {
+        const char& chr = candidate.at(position);
+        const char& chrKey = key.at(position);
+        if (chrKey != '*')
+        {
+            if (chrKey != chr)
+            {
+                return false;
+            }
+            continue;
+        }
+        const uint32_t letterBit = 1u << (chr - 'A');
+        if (outUsedPlainLetters & letterBit)
+        {
+            return false;
+        }
+        outUsedPlainLetters |= letterBit;
+        outKey.at(position) = chr;
+    }
+    return true;
+}
+
+// Appends the full keys of group to outKeys, at most maxKeys in total
+void expandProjectedGroup(const std::vector<std::vector<ProjectedGroup>>& levels, const std::vector<CryptoKeyList>& keyLists,
+                          const Combination& order, size_t level, uint32_t groupIndex, const CryptoKey& partialKey,
+                          size_t maxKeys, CryptoKeyList& outKeys)
+{
+    for(const std::pair<uint32_t, uint32_t>& origin : levels[level][groupIndex].origins)
+    {
+        if (outKeys.size() >= maxKeys)
+        {
+            return;
+        }
+        CryptoKey merged(getInitialKey());
+        const bool consistent = mergeTwoKeys(partialKey, keyLists[order[level]][origin.second], merged);
+        assert(consistent);
+        (void)consistent;
+        if (level == 0)
+        {
+            outKeys.emplace_back(merged);
+        }
+        else
+        {
+            expandProjectedGroup(levels, keyLists, order, level - 1, origin.first, merged, maxKeys, outKeys);
+        }
+    }
+}
+
+// Join of the key lists in order like combineKeys, but the partial keys are grouped by
+// their projection on the letters of the words not joined yet (and their plain letters),
+// so keys differing only in letters no later word uses are extended once. The full keys
+// are only expanded from the groups of the last word. The groups of all levels together
+// stay within the memory of maxKeys scored keys.
+CryptoKeyList combineKeysProjected(const std::vector<CryptoKeyList>& keyLists, const std::vector<LetterPositions>& positionsPerWord,
+                                   const Combination& order, size_t maxKeys, SearchControl* control)
+{
+    CryptoKeyList retVal;
+    if (order.empty())
+    {
+        return retVal;
+    }
+    const size_t maxBytes = maxKeys > std::numeric_limits<size_t>::max() / sizeof(ScoredKey) ?
+                            std::numeric_limits<size_t>::max() : maxKeys * sizeof(ScoredKey);
+    size_t usedBytes = 0;       // groups and origins of all levels
+    // letters of the words after each position of the order
+    std::vector<uint32_t> remainingLetters(order.size(), 0);
+    for(size_t level = order.size() - 1; level > 0; --level)
+    {
+        remainingLetters[level - 1] = remainingLetters[level] | getLetterMask(positionsPerWord[order[level]]);
+    }
+
+    std::vector<std::vector<ProjectedGroup>> levels(order.size());
+    bool truncated = false;
+    for(size_t level = 0; level < order.size(); ++level)
+    {
+        const CryptoKeyList& candidates = keyLists[order[level]];
+        const LetterPositions& wordLetters = positionsPerWord[order[level]];
+        ProjectedGroupIndex groupIndex;
+        std::vector<ProjectedGroup>& groups = levels[level];
+        // a level takes at most half of the memory left, so a cut level still leaves room for the next ones
+        const size_t levelMaxBytes = level + 1 < order.size() ? usedBytes + (maxBytes - usedBytes) / 2 : maxBytes;
+        const auto tpLevel = std::chrono::steady_clock::now();
+        size_t numKeys = 0;
+        size_t numConflicts = 0;
+        auto addJoinStep = [&](size_t inputKeys)
+        {
+            if (control)
+            {
+                SolverMetrics& metrics = control->getMetrics();
+                metrics.joins.emplace_back();
+                SolverMetrics::JoinStep& step = metrics.joins.back();
+                step.word = static_cast<size_t>(order[level]);
+                step.inputKeys = inputKeys;
+                step.candidates = candidates.size();
+                step.outputKeys = numKeys;
+                step.ms = getElapsedMs(tpLevel);
+                ++metrics.joinSteps;
+                metrics.prunedKeys += numConflicts;
+            }
+        };
+        auto addOrigin = [&](const CryptoKey& key, uint32_t usedPlainLetters, uint32_t parent, uint32_t candidate, size_t parentKeys) -> bool
+        {
+            std::pair<CryptoKey, uint32_t> projection(key, usedPlainLetters);
+            for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+            {
+                if (!(remainingLetters[level] & (1u << index)))
+                {
+                    projection.first.at(index) = '*';
+                }
+            }
+            // the index of this level is freed after the level, the groups are kept
+            const size_t indexBytes = groupIndex.size() * projectedIndexNodeBytes + groupIndex.bucket_count() * sizeof(void*);
+            auto found = groupIndex.find(projection);
+            const size_t newBytes = found == groupIndex.end() ?
+                                    projectedIndexNodeBytes + getGrowthBytes(groups) + sizeof(std::pair<uint32_t, uint32_t>) :
+                                    getGrowthBytes(groups[found->second].origins);
+            if (usedBytes + indexBytes + newBytes > levelMaxBytes)
+            {
+                truncated = true;
+                return false;
+            }
+            usedBytes += newBytes - (found == groupIndex.end() ? projectedIndexNodeBytes : 0);
+            if (found == groupIndex.end())
+            {
+                found = groupIndex.emplace(projection, static_cast<uint32_t>(groups.size())).first;
+                groups.push_back({projection.first, usedPlainLetters, {}, 0});
+            }
+            ProjectedGroup& group = groups[found->second];
+            group.origins.emplace_back(parent, candidate);
+            group.numKeys = std::min(maxKeys, group.numKeys + parentKeys);
+            numKeys = std::min(maxKeys, numKeys + parentKeys);
+            return true;
+        };
+
+        if (level == 0)
+        {
+            for(size_t candidate = 0; candidate < candidates.size(); ++candidate)
+            {
+                if (!addOrigin(candidates[candidate], getUsedPlainLetters(candidates[candidate]), 0, static_cast<uint32_t>(candidate), 1))
+                {
+                    break;
+                }
+            }
+            addJoinStep(1);
+            continue;
+        }
+        const std::vector<ProjectedGroup>& previousGroups = levels[level - 1];
+        logMessage(LogLevel::Info, "Combining {} key groups with {} keys\n", previousGroups.size(), candidates.size());
+        bool full = false;
+        for(size_t parent = 0; parent < previousGroups.size() && !full; ++parent)
+        {
+            if (control && control->shouldStop())
+            {
+                break;
+            }
+            const ProjectedGroup& previousGroup = previousGroups[parent];
+            for(size_t candidate = 0; candidate < candidates.size() && !full; ++candidate)
+            {
+                CryptoKey extended;
+                uint32_t usedPlainLetters;
+                if (extendProjectedKey(previousGroup.key, previousGroup.usedPlainLetters, candidates[candidate], wordLetters, extended, usedPlainLetters))
+                {
+                    full = !addOrigin(extended, usedPlainLetters, static_cast<uint32_t>(parent), static_cast<uint32_t>(candidate), previousGroup.numKeys);
+                }
+                else
+                {
+                    ++numConflicts;
+                }
+            }
+        }
+        size_t inputKeys = 0;
+        for(const ProjectedGroup& previousGroup : previousGroups)
+        {
+            inputKeys = std::min(maxKeys, inputKeys + previousGroup.numKeys);
+        }
+        addJoinStep(inputKeys);
+        logMessage(LogLevel::Info, "New key list: {} keys in {} groups\n", numKeys, groups.size());
+        if (truncated)
+        {
+            logMessage(LogLevel::Info, "Key groups reached the memory limit of {} MB, the result is incomplete\n", maxBytes / (1024 * 1024));
+            truncated = false;
+            if (control)
+            {
+                control->markTruncated();
+            }
+        }
+        if (control && !groups.empty())
+        {
+            CryptoKeyList firstKey;
+            expandProjectedGroup(levels, keyLists, order, level, 0, getInitialKey(), 1, firstKey);
+            control->offer(firstKey.front());
+        }
+        if (control && control->isStopped())
+        {
+            logMessage(LogLevel::Info, "Join stopped after {} of {} words\n", level + 1, order.size());
+            if (level + 1 < order.size())
+            {
+                return retVal;
+            }
+            break;
+        }
+    }
+
+    const std::vector<ProjectedGroup>& lastGroups = levels.back();
+    size_t lastKeys = 0;
+    for(const ProjectedGroup& group : lastGroups)
+    {
+        lastKeys = std::min(maxKeys + 1, lastKeys + group.numKeys);
+    }
+    for(size_t group = 0; group < lastGroups.size() && retVal.size() < maxKeys; ++group)
+    {
+        expandProjectedGroup(levels, keyLists, order, order.size() - 1, static_cast<uint32_t>(group), getInitialKey(), maxKeys, retVal);
+    }
+    if (control && lastKeys > maxKeys)
+    {
+        control->markTruncated();
+    }
+    return retVal;
+}
+
+CryptoKeyList combineKeysSmart(const CryptogramWords& cryptogram, size_t maxKeys, SearchControl* control)
+{
+    CryptoKeyList retVal;
+    CombinationList comboList;
+    comboList.emplace_back(planWordOrder(cryptogram));
+    bool allWordsHaveKeys = !comboList[0].empty();
+    for(int wordIndex : comboList[0])
+    {
+        if(cryptogram.keysPerWord[wordIndex].empty())
+        {
+            allWordsHaveKeys = false;
+            break;
+        }
+    }
+
+    if(allWordsHaveKeys)
+    {
+        retVal = combineKeysProjected(cryptogram.keysPerWord, cryptogram.positionsPerWord, comboList[0], maxKeys, control);
+    }
+
+    return retVal;
+}
+
+CombinationList createAllPermutations(size_t numOfElements)
+{
+    CombinationList retVal;
+    std::vector<int> initVec;
+    initVec.resize(numOfElements);
+    retVal.reserve(numOfElements*numOfElements);
+    for(auto ind = 0; ind < numOfElements; ++ind)
+    {
+        initVec[ind] = ind;
+    }
+
+    do
+    {
+        retVal.emplace_back(initVec);
+    } while (std::next_permutation(initVec.begin(), initVec.end()));
+
+    return retVal;
+}
+
+CombinationList createSingleCombination(size_t numOfElements)
+{
+    CombinationList retVal;
+    retVal.resize(1);
+    for(auto ind = 0; ind < numOfElements; ++ind)
+    {
+        retVal[0].emplace_back(ind);
+    }
+
+    return retVal;
+}
+
+// Only the letters of a word are counted, the mutator draws plain letters from them
+void analyseWord(TextView word, LetterCounts& counts)
+{
+    for (size_t index = 0; index < word.size(); ++index)
+    {
+        const char chr = word.at(index);
+        if (chr >= 'A' && chr <= 'Z')
+        {
+            counts[chr - 'A']++;
+        }
+    }
+}
+
+MappedFile::MappedFile(const std::string& fileName)
+{
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0)
+    {
+        size = static_cast<size_t>(fileStat.st_size);
+        mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        opened = mapping != MAP_FAILED;
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (opened && mapping)
+    {
+        munmap(mapping, size);
+    }
+}
+
+// Upper case copy of ASCII text like ::toupper in the C locale, 16 characters at a time
+// where SSE2 is available
+void copyUpperCase(const char* text, size_t length, char* outText)
+{
+    size_t index = 0;
+#if defined(__SSE2__)
+    const __m128i beforeA = _mm_set1_epi8('a' - 1);
+    const __m128i afterZ = _mm_set1_epi8('z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for(; index + 16 <= length; index += 16)
+    {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + index));
+        const __m128i isLower = _mm_and_si128(_mm_cmpgt_epi8(chars, beforeA), _mm_cmplt_epi8(chars, afterZ));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outText + index), _mm_xor_si128(chars, _mm_and_si128(isLower, caseBit)));
+    }
+#endif
+    for(; index < length; ++index)
+    {
+        const char chr = text[index];
+        outText[index] = chr >= 'a' && chr <= 'z' ? chr - 'a' + 'A' : chr;
+    }
+}
+
+// Upper-cased words of one chunk of a wordlist with their hash and line number in the
+// chunk, and the letters of all its words
+struct WordListChunk
+{
+    struct ChunkWord
+    {
+        TextView word;          // view into upperCase
+        uint32_t hash;
+        WordRank line;
+    };
+
+    std::vector<char> upperCase;
+    std::vector<ChunkWord> words;
+    WordRank lines = 0;
+    LetterCounts letterCounts{};
+};
+
+// chunk starts at a line and ends after a newline or at the end of the file
+void parseWordListChunk(TextView chunk, WordListChunk& outChunk)
+{
+    std::vector<char>& upperCase = outChunk.upperCase;
+    upperCase.resize(chunk.size());
+    copyUpperCase(chunk.data(), chunk.size(), upperCase.data());
+    outChunk.words.reserve(chunk.size() / 8);
+    size_t lineBegin = 0;
+    while (lineBegin < chunk.size())
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(upperCase.data() + lineBegin, '\n', chunk.size() - lineBegin));
+        const size_t nextLine = lineEnd ? lineEnd - upperCase.data() + 1 : chunk.size();
+        size_t length = (lineEnd ? nextLine - 1 : nextLine) - lineBegin;
+        if (length > 0 && upperCase[lineBegin + length - 1] == '\r')
+        {
+            --length;
+        }
+        if (length > 0)
+        {
+            const TextView word(upperCase.data() + lineBegin, std::min<size_t>(length, maxWordLength));
+            outChunk.words.push_back({word, Word::hasher::hash(word.data(), word.size()), outChunk.lines});
+            analyseWord(word, outChunk.letterCounts);
+        }
+        ++outChunk.lines;
+        lineBegin = nextLine;
+    }
+}
+
+// The chunks of text, split at newlines, for at most maxChunks threads
+std::vector<TextView> splitIntoLineChunks(TextView text, size_t maxChunks)
+{
+    constexpr size_t minChunkSize = 256 * 1024;
+    const size_t numChunks = std::max<size_t>(1, std::min(maxChunks, text.size() / minChunkSize));
+    std::vector<TextView> retVal;
+    size_t chunkBegin = 0;
+    for(size_t index = 1; index <= numChunks && chunkBegin < text.size(); ++index)
+    {
+        size_t chunkEnd = index == numChunks ? text.size() : std::max(chunkBegin, text.size() * index / numChunks);
+        while (chunkEnd < text.size() && text.at(chunkEnd - 1) != '\n')
+        {
+            ++chunkEnd;
+        }
+        retVal.emplace_back(text.substr(chunkBegin, chunkEnd - chunkBegin));
+        chunkBegin = chunkEnd;
+    }
+    return retVal;
+}
+
+// 64 bits of MurmurHash3 over text of any size
+uint64_t hashContent(TextView text, uint32_t seed)
+{
+    constexpr size_t pieceSize = 1u << 30;
+    uint64_t retVal[2] = {seed, 0};
+    size_t offset = 0;
+    do
+    {
+        const size_t length = std::min(pieceSize, text.size() - offset);
+        MurmurHash3_x64_128(text.data() + offset, static_cast<int>(length), static_cast<uint32_t>(retVal[0]), retVal);
+        offset += length;
+    } while (offset < text.size());
+    return retVal[0];
+}
+
+// Words already in outSet keep their rank, new ones are ranked from firstRank on by their
+// line number. The file is mapped and its chunks are upper-cased, split and hashed in
+// parallel, the merge into outSet goes in file order so the first occurrence of a word
+// keeps its rank. The letters of the new words are added to freqMap, the chunks count all
+// their words and the merge takes the ones already in outSet off again. outContentHash gets
+// the hash of the file seeded with its value on entry.
+void loadWordListIntoSet(const std::string& filename, WordList& outSet, LetterFrequencyMap& freqMap, WordRank firstRank,
+                         uint64_t* outContentHash)
+{
+    logMessage(LogLevel::Info, "Start loading wordlist from file: \n{}\n", filename);
+    auto tpBegin = std::chrono::steady_clock::now();
+    const MappedFile wordlistFile(filename);
+    if (wordlistFile.isOpen())
+    {
+        const TextView text = wordlistFile.view();
+        if (outContentHash)
+        {
+            *outContentHash = hashContent(text, static_cast<uint32_t>(*outContentHash));
+        }
+        const std::vector<TextView> chunks = splitIntoLineChunks(text, std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<WordListChunk> parsedChunks(chunks.size());
+        std::vector<std::thread> workers;
+        for(size_t index = 1; index < chunks.size(); ++index)
+        {
+            workers.emplace_back(parseWordListChunk, chunks[index], std::ref(parsedChunks[index]));
+        }
+        if (!chunks.empty())
+        {
+            parseWordListChunk(chunks[0], parsedChunks[0]);
+        }
+        for(std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        size_t numWords = 0;
+        for(const WordListChunk& chunk : parsedChunks)
+        {
+            numWords += chunk.words.size();
+        }
+        outSet.reserve(outSet.size() + numWords);
+        WordRank rank = firstRank;
+        LetterCounts duplicateCounts{};
+        for(const WordListChunk& chunk : parsedChunks)
+        {
+            for(const WordListChunk::ChunkWord& entry : chunk.words)
+            {
+                if (!outSet.emplace(entry.word, rank + entry.line, entry.hash).second)
+                {
+                    analyseWord(entry.word, duplicateCounts);
+                }
+            }
+            rank += chunk.lines;
+        }
+        for(size_t letter = 0; letter < ALPHABET_LETTERS_NUM; ++letter)
+        {
+            unsigned int count = 0;
+            for(const WordListChunk& chunk : parsedChunks)
+            {
+                count += chunk.letterCounts[letter];
+            }
+            if (count > duplicateCounts[letter])
+            {
+                freqMap[static_cast<char>('A' + letter)] += count - duplicateCounts[letter];
+            }
+        }
+        auto tpEnd = std::chrono::steady_clock::now();
+        auto microsecondsElapsed = std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count();
+
+        double secondsElapsed = microsecondsElapsed / 1000000.0;
+
+        logMessage(LogLevel::Info, "Wordlist loaded in {:.3} s by {} threads\nWord count: {} words\nSpeed: {:.3} MB/s\n",
+                   secondsElapsed, chunks.size(), outSet.size(), text.size() / secondsElapsed / 1024 / 1024);
+
+    }
+    else
+    {
+        logMessage(LogLevel::Error, "Error opening file\n");
+    }
+}
+
+template<typename Mutator>
+CryptoKeyData MutateKey(const CryptoKeyData& sourceKeyData, std::set<char>& goodPos, const Mutator& mutator, const ActiveLetters& activeLetters,
+                        std::default_random_engine& rng)
+{
+    CryptoKeyData retVal = sourceKeyData;
+    CryptoKey& keyToMutate = retVal.first;
+    if (activeLetters.positions.empty())
+    {
+        return retVal;
+    }
+    std::uniform_int_distribution<unsigned int> mutateGoodChanceDist(0, 1000);
+    std::uniform_int_distribution<size_t> letterDist(0, activeLetters.positions.size() - 1);
+    unsigned int rnd;
+    unsigned int chance;
+    do
+    {
+        rnd = activeLetters.positions[letterDist(rng)];
+        chance = mutateGoodChanceDist(rng);
+    } while ((goodPos.find(rnd) != goodPos.end()) && (chance > mutateGoodLetterFactor));
+    char& chrToMutate = keyToMutate.at(rnd);
+    const char newVal = mutator.pickLetter(rng);
+
+    size_t swapPos = keyToMutate.find_first_of(newVal);
+    if (swapPos != CryptoKey::npos && activeLetters.fixedKey.at(swapPos) != '*')
+    {
+        // the plain letter belongs to a fixed cipher letter
+        return retVal;
+    }
+    if (swapPos != CryptoKey::npos)
+    {
+        keyToMutate.at(swapPos) = chrToMutate;
+    }
+    chrToMutate = newVal;
+    canonicalizeKey(keyToMutate, activeLetters);
+    return retVal;
+}
+
+template CryptoKeyData MutateKey(const CryptoKeyData&, std::set<char>&, const FrequencyMutator<ALPHABET_LETTERS_NUM>&, const ActiveLetters&,
+                                 std::default_random_engine&);
+template CryptoKeyData MutateKey(const CryptoKeyData&, std::set<char>&, const UniformMutator<ALPHABET_LETTERS_NUM>&, const ActiveLetters&,
+                                 std::default_random_engine&);
+
+// Views of the words of the line as found by WordTokenizer, nothing is copied
+size_t splitLineToWords(TextView line, WordSpans& outWords)
+{
+    outWords.clear();
+    WordTokenizer tokenizer(line);
+    TextView word;
+    while (tokenizer.next(word))
+    {
+        outWords.emplace_back(word);
+    }
+    return outWords.size();
+}
+
+// The word as it is or without the apostrophes around it
+bool isDictionaryWord(TextView word, const WordList& wordList)
+{
+    if (wordList.find(word) != wordList.end())
+    {
+        return true;
+    }
+    const TextView trimmedWord = trimApostrophes(word);
+    return trimmedWord.size() != word.size() && isDictionaryWord(trimmedWord, wordList);
+}
+
+// Share of the word characters of the text in dictionary words, streams over the words
+double calcTextQuality(TextView text, const WordList& wordList)
+{
+    double retVal;
+    size_t allTextLength = 0;
+    size_t goodTextLength = 0;
+    WordTokenizer tokenizer(text);
+    TextView word;
+    while (tokenizer.next(word))
+    {
+        allTextLength += word.size();
+        if (isDictionaryWord(word, wordList))
+        {
+            goodTextLength += word.size();
+        }
+    }
+    retVal = allTextLength > 0 ? (double)goodTextLength / (double)allTextLength : 0.0;
+    return retVal;
+}
+
+uint32_t getUsedPlainLetters(const CryptoKey& key)
+{
+    uint32_t retVal = 0;
+    for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+    {
+        const char& chr = key.at(index);
+        if (chr != '*')
+        {
+            retVal |= 1u << (chr - 'A');
+        }
+    }
+    return retVal;
+}
+
+// Cheaper version of mergeTwoKeys for a candidate key that only assigns the given positions
+inline bool isCandidateCompatible(const CryptoKey& key, uint32_t usedPlainLetters, const CryptoKey& candidate, const LetterPositions& positions)
+{
+    for(unsigned int position : positions)
+    {
+        const char& chrKey = key.at(position);
+        const char& chrCandidate = candidate.at(position);
+        if (chrKey == '*')
+        {
+            if (usedPlainLetters & (1u << (chrCandidate - 'A')))
+            {
+                return false;
+            }
+        }
+        else if (chrKey != chrCandidate)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Dictionary coverage of a partial key: number of text letters in words that are fully
+// decided by the key and are dictionary words. Returns -1 if a fully decided word is
+// not in the dictionary, such a key can never be completed. Wildcard words only count
+// when they happen to decrypt to a dictionary word.
+double calcKeyCoverage(const CryptoKey& key, const CryptogramWords& cryptogram, const std::vector<bool>& joinedWords, const WordList& wordList)
+{
+    double retVal = 0;
+    Word decrypted;
+    for(size_t wordIndex = 0; wordIndex < cryptogram.numWords; ++wordIndex)
+    {
+        const TextView& word = cryptogram.words[wordIndex];
+        if (joinedWords[wordIndex])
+        {
+            retVal += word.size();
+            continue;
+        }
+        if (word.size() > maxWordLength)
+        {
+            // no candidates, so it is a wildcard that can never decrypt to a dictionary word
+            continue;
+        }
+        decrypted = Word();
+        bool complete = true;
+        for(size_t index = 0; index < word.size(); ++index)
+        {
+            const char& chr = isCipherLetter(word.at(index)) ? key.at(word.at(index) - 'A') : word.at(index);
+            if (chr == '*')
+            {
+                complete = false;
+                break;
+            }
+            decrypted.push_back(chr);
+        }
+        if (complete)
+        {
+            if (isDictionaryWord(decrypted, wordList))
+            {
+                retVal += word.size();
+            }
+            else if (!cryptogram.wildcardWords[wordIndex])
+            {
+                return -1;
+            }
+        }
+    }
+    return retVal;
+}
+
+// Forward check of a partial key against the words not joined yet: sum of the logarithms
+// of compatible candidate counts, -1 if some word has no compatible candidate left
+double calcKeyOpenness(const CryptoKey& key, const CryptogramWords& cryptogram, const std::vector<bool>& joinedWords)
+{
+    double retVal = 0;
+    const uint32_t usedPlainLetters = getUsedPlainLetters(key);
+    for(size_t wordIndex = 0; wordIndex < cryptogram.numWords; ++wordIndex)
+    {
+        if (joinedWords[wordIndex] || cryptogram.wildcardWords[wordIndex])
+        {
+            continue;
+        }
+        size_t compatible = 0;
+        for(const CryptoKey& candidate : cryptogram.keysPerWord[wordIndex])
+        {
+            if (isCandidateCompatible(key, usedPlainLetters, candidate, cryptogram.positionsPerWord[wordIndex]))
+            {
+                ++compatible;
+            }
+        }
+        if (compatible == 0)
+        {
+            return -1;
+        }
+        retVal += std::log(static_cast<double>(compatible));
+    }
+    return retVal;
+}
+
+// Beam search over the planned word order: after every join only the best beamWidth
+// partial keys survive. A child is ranked by its coverage, the forward check against the
+// words not joined yet drops dead children and its openness breaks the coverage ties.
+// The memory limit (in keys) bounds the beam and the heap of the next beam together.
+CryptoKeyList beamSearchKeys(const CryptogramWords& cryptogram, const Combination& order, const WordList& wordList,
+                             size_t beamWidth, size_t maxKeys, SearchControl& control)
+{
+    CryptoKeyList retVal;
+    size_t width = std::min(beamWidth, std::max<size_t>(1, maxKeys / 2));
+    if (width < beamWidth)
+    {
+        logMessage(LogLevel::Info, "Beam width limited to {} by the memory limit\n", width);
+        control.markTruncated();
+    }
+
+    std::vector<bool> joinedWords(cryptogram.numWords, false);
+    std::vector<ScoredKey> beam;
+    beam.emplace_back(0.0, getInitialKey());
+    CryptoKey merged(getInitialKey());
+
+    for(int wordIndex : order)
+    {
+        joinedWords[wordIndex] = true;
+        const auto tpJoin = std::chrono::steady_clock::now();
+        std::priority_queue<ScoredKey, std::vector<ScoredKey>, ScoredKeyGreater> nextBeam;
+        size_t children = 0;
+        size_t tried = 0;
+        size_t scored = 0;
+        for(const ScoredKey& scoredKey : beam)
+        {
+            if (control.shouldStop())
+            {
+                break;
+            }
+            for(const CryptoKey& wordKey : cryptogram.keysPerWord[wordIndex])
+            {
+                ++tried;
+                if (!mergeTwoKeys(scoredKey.second, wordKey, merged))
+                {
+                    continue;
+                }
+                ++scored;
+                double score = calcKeyCoverage(merged, cryptogram, joinedWords, wordList);
+                if (score < 0)
+                {
+                    continue;
+                }
+                if (nextBeam.size() >= width && score + 1.0 <= nextBeam.top().first)
+                {
+                    // even the best openness can not lift it above the current worst
+                    continue;
+                }
+                double openness = calcKeyOpenness(merged, cryptogram, joinedWords);
+                if (openness < 0)
+                {
+                    continue;
+                }
+                // openness is a sum of logarithms and stays far below 1000
+                score += openness / 1000.0;
+                ++children;
+                if (nextBeam.size() < width)
+                {
+                    nextBeam.emplace(score, merged);
+                }
+                else if (score > nextBeam.top().first)
+                {
+                    nextBeam.pop();
+                    nextBeam.emplace(score, merged);
+                }
+            }
+        }
+
+        const size_t inputKeys = beam.size();
+        beam.clear();
+        while (!nextBeam.empty())
+        {
+            beam.emplace_back(nextBeam.top());
+            nextBeam.pop();
+        }
+        SolverMetrics& metrics = control.getMetrics();
+        metrics.joins.emplace_back();
+        SolverMetrics::JoinStep& step = metrics.joins.back();
+        step.word = static_cast<size_t>(wordIndex);
+        step.inputKeys = inputKeys;
+        step.candidates = cryptogram.keysPerWord[wordIndex].size();
+        step.outputKeys = beam.size();
+        step.ms = getElapsedMs(tpJoin);
+        ++metrics.joinSteps;
+        metrics.scoringCalls += scored;
+        // conflicts, dead ends and the keys cut by the width
+        metrics.prunedKeys += tried - beam.size();
+        logMessage(LogLevel::Info, "Beam after joining word {}: {} of {} keys\n", cryptogram.words[wordIndex], beam.size(), children);
+        if (beam.empty())
+        {
+            break;
+        }
+        control.offer(beam.back().second);
+        if (control.isStopped())
+        {
+            // only a beam over all words holds full keys
+            if (wordIndex != order.back())
+            {
+                beam.clear();
+            }
+            break;
+        }
+    }
+
+    // the heap was drained from the worst to the best
+    for(auto it = beam.rbegin(); it != beam.rend(); ++it)
+    {
+        retVal.emplace_back(it->second);
+    }
+    return retVal;
+}
+
+// Zipf's law: the probability of a word falls with its frequency rank, so the cost of a
+// word is the negative logarithm of its probability up to a constant
+inline double getWordCost(WordRank rank)
+{
+    return std::log(rank + 1.0);
+}
+
+struct SearchNode
+{
+    double estimate;            // cost + cost of the candidate + lower bound for the rest
+    double cost;                // cost of the words already joined into key
+    CryptoKey key;
+    unsigned int depth;         // position in the planned order of the word to join next
+    size_t candidateIndex;      // candidate of that word to join into key
+};
+
+struct SearchNodeGreater
+{
+    bool operator()(const SearchNode& node1, const SearchNode& node2) const
+    {
+        return node1.estimate > node2.estimate;
+    }
+};
+
+size_t findCompatibleCandidate(const CryptoKey& key, const CryptoKeyList& candidates, const LetterPositions& positions, size_t startIndex)
+{
+    const uint32_t usedPlainLetters = getUsedPlainLetters(key);
+    for(size_t index = startIndex; index < candidates.size(); ++index)
+    {
+        if (isCandidateCompatible(key, usedPlainLetters, candidates[index], positions))
+        {
+            return index;
+        }
+    }
+    return candidates.size();
+}
+
+// Best-first (A*) search over the planned word order, the cost of a key is the sum of the
+// word costs of its words. The candidates of every word are sorted by rank, so a node only
+// pushes its next sibling and its first child, which keeps the frontier small. The lower
+// bound of the words not joined yet is the cost of their most frequent candidate, so full
+// keys are emitted in the order of their cost.
+CryptoKeyList bestFirstSearchKeys(const CryptogramWords& cryptogram, const Combination& order, const WordList& wordList,
+                                  size_t maxSolutions, size_t maxKeys, const SolutionCallback& onSolution, SearchControl& control)
+{
+    CryptoKeyList retVal;
+    if (order.empty())
+    {
+        return retVal;
+    }
+    const std::vector<CryptoKeyList>& keysPerWord = cryptogram.keysPerWord;
+    const std::vector<WordRankList>& ranksPerWord = cryptogram.ranksPerWord;
+    const std::vector<LetterPositions>& positionsPerWord = cryptogram.positionsPerWord;
+
+    std::vector<double> remainingCost(order.size() + 1, 0.0);
+    for(size_t depth = order.size(); depth-- > 0;)
+    {
+        const WordRankList& ranks = ranksPerWord[order[depth]];
+        if (ranks.empty())
+        {
+            return retVal;
+        }
+        remainingCost[depth] = remainingCost[depth + 1] + getWordCost(ranks.front());
+    }
+
+    std::vector<std::vector<bool>> joinedWordsPerDepth;
+    std::vector<bool> joinedWords(cryptogram.numWords, false);
+    for(int wordIndex : order)
+    {
+        joinedWords[wordIndex] = true;
+        joinedWordsPerDepth.emplace_back(joinedWords);
+    }
+
+    std::priority_queue<SearchNode, std::vector<SearchNode>, SearchNodeGreater> frontier;
+    auto pushNode = [&](const CryptoKey& key, double cost, unsigned int depth, size_t startIndex)
+    {
+        const int wordIndex = order[depth];
+        size_t candidateIndex = findCompatibleCandidate(key, keysPerWord[wordIndex], positionsPerWord[wordIndex], startIndex);
+        if (candidateIndex < keysPerWord[wordIndex].size())
+        {
+            SearchNode node;
+            node.cost = cost;
+            node.estimate = cost + getWordCost(ranksPerWord[wordIndex][candidateIndex]) + remainingCost[depth + 1];
+            node.key = key;
+            node.depth = depth;
+            node.candidateIndex = candidateIndex;
+            frontier.emplace(std::move(node));
+        }
+    };
+
+    pushNode(getInitialKey(), 0.0, 0, 0);
+    CryptoKey merged(getInitialKey());
+    unsigned int deepestJoin = 0;
+    size_t scored = 0;
+    size_t deadEnds = 0;
+    while (!frontier.empty() && retVal.size() < maxSolutions)
+    {
+        if (control.shouldStop())
+        {
+            logMessage(LogLevel::Info, "Search stopped with {} solutions\n", retVal.size());
+            break;
+        }
+        if (frontier.size() > maxKeys)
+        {
+            logMessage(LogLevel::Info, "Search frontier reached the memory limit of {} keys\n", maxKeys);
+            control.markTruncated();
+            break;
+        }
+        const SearchNode node = frontier.top();
+        frontier.pop();
+        const int wordIndex = order[node.depth];
+        pushNode(node.key, node.cost, node.depth, node.candidateIndex + 1);
+
+        bool merge = mergeTwoKeys(node.key, keysPerWord[wordIndex][node.candidateIndex], merged);
+        assert(merge);
+        (void)merge;
+        const double cost = node.cost + getWordCost(ranksPerWord[wordIndex][node.candidateIndex]);
+        if (node.depth + 1 > deepestJoin)
+        {
+            // the first key to reach a depth is the cheapest one there
+            deepestJoin = node.depth + 1;
+            control.offer(merged);
+        }
+        if (node.depth + 1 == order.size())
+        {
+            retVal.emplace_back(merged);
+            if (onSolution)
+            {
+                onSolution(merged, cost);
+            }
+            continue;
+        }
+        const std::vector<bool>& joinedWordsNow = joinedWordsPerDepth[node.depth];
+        ++scored;
+        if (calcKeyCoverage(merged, cryptogram, joinedWordsNow, wordList) < 0
+            || calcKeyOpenness(merged, cryptogram, joinedWordsNow) < 0)
+        {
+            ++deadEnds;
+            continue;
+        }
+        pushNode(merged, cost, node.depth + 1, 0);
+    }
+    control.getMetrics().scoringCalls += scored;
+    control.getMetrics().prunedKeys += deadEnds;
+    return retVal;
+}
+
+void removeElementWithCryptoKey(SolutionMap& sMap, const CryptoKeyData& cKey, int iterations) 
+{
+    for (auto it = sMap.begin(); it != sMap.end(); ++it) 
+    {
+        const CryptoKey& elementKey = (*it).second.first.first;
+        if (elementKey == cKey.first) 
+        {
+            logMessage(LogLevel::Debug, "Removing solution   (Q: {:.4} K:{:8}): {}\n", it->first, iterations, TextView(it->second.second));
+            sMap.erase(it);
+            break;
+        }
+    }
+}
+
+bool hasSolutionWithCryptoKey(const SolutionMap& sMap, const CryptoKey& cKey)
+{
+    for (auto it = sMap.begin(); it != sMap.end(); ++it)
+    {
+        if (it->second.first.first == cKey)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<TextSizeClass SizeClass, typename Scorer, typename Mutator, typename Acceptor>
+void addOneBetterSolution(SolutionMap& sMap, const CryptoKeyData& initialKey, TextView cryptoText,
+                          Scorer& scorer, const Mutator& mutator, const ActiveLetters& activeLetters,
+                          std::default_random_engine& rng, SearchControl* control, SeenKeyFilter* seenKeys)
+{
+    bool added = false;
+    CryptoKeyData newKeyData = initialKey;
+    canonicalizeKey(newKeyData.first, activeLetters);
+    const CryptoKeyData canonicalInitialKey = newKeyData;
+    TextBuffer<SizeClass> decryptedText(cryptoText.size());
+    std::set<char> goodPositions;
+    const double minQuality = scorer.score(cryptoText, newKeyData.first, decryptedText);
+    double walkQuality = minQuality;
+    size_t scored = 1;
+    size_t seenChecks = 0;
+    size_t seenHits = 0;
+    if (seenKeys)
+    {
+        seenKeys->set(newKeyData.first);
+    }
+    while (!added)
+    {
+        CryptoKeyData previousKeyData = newKeyData;
+        newKeyData = MutateKey(newKeyData, goodPositions, mutator, activeLetters, rng);
+        newKeyData.second++;
+        if (control && control->shouldStop())
+        {
+            break;
+        }
+        if (newKeyData.second >= keyTryLimit)
+        {
+            removeElementWithCryptoKey(sMap, canonicalInitialKey, newKeyData.second);
+            break;
+        }
+        if (newKeyData.first == previousKeyData.first)
+        {
+            // the mutation did not touch any letter of the text, the score can not change
+            continue;
+        }
+        if (seenKeys)
+        {
+            // a key a walk already moved to is tabu, it is not scored again
+            ++seenChecks;
+            if (seenKeys->test(newKeyData.first))
+            {
+                ++seenHits;
+                if (!Acceptor::keepsUnscoredKey())
+                {
+                    newKeyData.first = previousKeyData.first;
+                }
+                continue;
+            }
+        }
+        ++scored;
+        double quality = scorer.score(cryptoText, newKeyData.first, decryptedText);
+        if (quality <= minQuality)
+        {
+            if (Acceptor::keepsKey(quality, walkQuality))
+            {
+                walkQuality = quality;
+                if (seenKeys)
+                {
+                    seenKeys->set(newKeyData.first);
+                }
+            }
+            else
+            {
+                // a key the walk undid stays unseen, a later walk may come to it from a better key
+                newKeyData.first = previousKeyData.first;
+            }
+        }
+        else
+        {
+            const TextView decryptedView = decryptedText.view();
+            auto pair = std::make_pair(newKeyData, CryptoText(decryptedView.data(), decryptedView.size()));
+            if (!hasSolutionWithCryptoKey(sMap, newKeyData.first))
+            {
+                sMap.insert(std::make_pair(quality, pair));
+            }
+            if (control)
+            {
+                control->offer(newKeyData.first, quality);
+            }
+            logMessage(LogLevel::Debug, "New better solution (Q: {:.4} K:{:8}): {}\n", quality, newKeyData.second, decryptedText.view());
+            added = true;
+        }
+    }
+    if (control)
+    {
+        SolverMetrics& metrics = control->getMetrics();
+        metrics.mutations += newKeyData.second - initialKey.second;
+        metrics.scoringCalls += scored;
+        metrics.seenKeyChecks += seenChecks;
+        metrics.seenKeyHits += seenHits;
+    }
+}
+
+// 12 bits per key keep the false positives around 2% with 6 bits per key in blocks
+SeenKeyFilter::SeenKeyFilter(size_t memoryBytes)
+    : numWords(std::max<size_t>(1, memoryBytes / sizeof(uint64_t))),
+      capacity(std::max<size_t>(1, numWords * 64 / 12))
+{
+    words.reset(new std::atomic<uint64_t>[numWords]);
+    clear();
+}
+
+void SeenKeyFilter::clear()
+{
+    for(size_t index = 0; index < numWords; ++index)
+    {
+        words[index].store(0, std::memory_order_relaxed);
+    }
+    numKeys.store(0, std::memory_order_relaxed);
+}
+
+std::atomic<uint64_t>& SeenKeyFilter::getWord(const CryptoKey& key, uint64_t& outMask) const
+{
+    // a 128-bit hash: bitsPerKey positions of 6 bits from the first half, the word from the
+    // high 32 bits of the second, so the positions and the word are independent
+    uint64_t hash[2];
+    MurmurHash3_x64_128(key.c_str(), static_cast<int>(key.size()), 0xDEADBEEF, hash);
+    outMask = 0;
+    for(unsigned int index = 0; index < bitsPerKey; ++index)
+    {
+        outMask |= 1ull << ((hash[0] >> (6 * index)) & 63);
+    }
+    return words[(hash[1] >> 32) * numWords >> 32];
+}
+
+bool SeenKeyFilter::test(const CryptoKey& key) const
+{
+    uint64_t mask = 0;
+    const std::atomic<uint64_t>& word = getWord(key, mask);
+    return (word.load(std::memory_order_relaxed) & mask) == mask;
+}
+
+void SeenKeyFilter::set(const CryptoKey& key)
+{
+    uint64_t mask = 0;
+    std::atomic<uint64_t>& word = getWord(key, mask);
+    const uint64_t bits = word.load(std::memory_order_relaxed);
+    if ((bits & mask) == mask)
+    {
+        return;
+    }
+    // a plain read-modify-write, a bit lost to a concurrent insert only costs a rescoring
+    word.store(bits | mask, std::memory_order_relaxed);
+    const size_t keys = numKeys.load(std::memory_order_relaxed) + 1;
+    numKeys.store(keys, std::memory_order_relaxed);
+    if (keys >= capacity)
+    {
+        clear();
+    }
+}
+
+bool SeenKeyFilter::testAndSet(const CryptoKey& key)
+{
+    if (test(key))
+    {
+        return true;
+    }
+    set(key);
+    return false;
+}
+
+void removeRandomMember(CryptoKeySet& outSet, std::default_random_engine& rng)
+{
+    std::uniform_int_distribution<size_t> dist(0, outSet.size() - 1);
+    size_t rnd = dist(rng);
+
+    size_t cntIter = 0;
+    for (auto it = outSet.begin(); it != outSet.end(); ++it) 
+    {
+        if (cntIter == rnd) 
+        {
+            outSet.erase(it);
+            break;
+        }
+        cntIter++;
+    }
+}
+template<int NumLetters>
+void addRandomKey(CryptoKeySet& outSet, const ActiveLetters& activeLetters, std::default_random_engine& rng)
+{
+    CryptoKey newKey;
+    std::uniform_int_distribution<int> randomLetter('A', 'Z');
+    while (newKey.size() < NumLetters)
+    {
+        char chr = static_cast<char>(randomLetter(rng));
+        if (newKey.find_first_of(chr) == CryptoKey::npos)
+        {
+            newKey.push_back(chr);
+        }
+    }
+    for(size_t index = 0; index < ALPHABET_LETTERS_NUM; ++index)
+    {
+        const char& fixedChr = activeLetters.fixedKey.at(index);
+        if (fixedChr != '*')
+        {
+            std::swap(newKey.at(newKey.find_first_of(fixedChr)), newKey.at(index));
+        }
+    }
+    canonicalizeKey(newKey, activeLetters);
+    outSet.insert(std::move(newKey));
+}
+
+template void addRandomKey<ALPHABET_LETTERS_NUM>(CryptoKeySet&, const ActiveLetters&, std::default_random_engine&);
+
+template<int NumLetters>
+CryptoKeySet getBestKeys(const SolutionMap& sMap, int numberOfKeys, const ActiveLetters& activeLetters, std::default_random_engine& rng)
+{
+    CryptoKeySet retVal;
+
+    for (auto it = sMap.rbegin(); it != sMap.rend(); ++it)
+    {
+        retVal.insert(it->second.first.first);
+        if (retVal.size() >= numberOfKeys) // we gathered numberOfKeys
+        {
+            auto itNext = it;
+            ++itNext;
+            if (itNext != sMap.rend()) // we are not at the last place (first)
+            {
+                if (itNext->first == it->first) // if the next Solution is with the same quality we add it too
+                {
+                    continue;
+                }
+            }
+            break;
+        }
+    }
+
+    while (retVal.size() > numberOfKeys)
+    {
+        removeRandomMember(retVal, rng);
+    }
+
+    while (retVal.size() < numberOfKeys)
+    {
+        addRandomKey<NumLetters>(retVal, activeLetters, rng);
+    }
+
+    return retVal;
+}
+
+// Hill climber over full keys, the engine of the first implementation. The best key so far
+// is mutated until its quality improves, a key that does not improve within keyTryLimit
+// mutations is dropped and the climb goes on from the next best or a random key. Stops
+// when a key solves the text as Scorer::isSolved decides, GOOD_SOLUTION_NUM keys were
+// collected or the control stops it, and returns the keys that solve it. The letters of rootKey are
+// never mutated. The random generator starts from seed and rootIndex. With a checkpoint the
+// climb of rootIndex goes on from the recorded pool and random generator, and records them
+// between two mutation walks. Scorer rates the
+// decoded text, Mutator picks the new plain letters and Acceptor the keys a walk goes on
+// from, see getClimbFunction.
+template<TextSizeClass SizeClass, typename Scorer, typename Mutator, typename Acceptor>
+CryptoKeyList climbKeys(TextView cryptoText, const DictionaryTier& tier, SearchControl& control, const CryptoKey& rootKey,
+                        SeenKeyFilter* seenKeys, size_t rootIndex, unsigned int seed)
+{
+    CryptoKeyList retVal;
+    Scorer scorer(tier);
+    const Mutator mutator(tier);
+    TextBuffer<SizeClass> decryptedText(cryptoText.size());
+    ActiveLetters activeLetters = getActiveLetters(cryptoText);
+    fixLetters(activeLetters, rootKey);
+    std::seed_seq seeds{seed, static_cast<unsigned int>(rootIndex)};
+    std::default_random_engine rng(seeds);
+    const auto tpClimb = std::chrono::steady_clock::now();
+    SolutionMap solutionMap;
+    CheckpointStore* checkpoint = control.getCheckpoint();
+    ClimbProgress progress;
+    if (checkpoint && checkpoint->getClimb(progress) && progress.rootIndex == rootIndex)
+    {
+        std::istringstream rngState(progress.rngState);
+        rngState >> rng;
+        for(const std::pair<double, CryptoKeyData>& entry : progress.pool)
+        {
+            const CryptoText decryptedText = transformText<ALPHABET_LETTERS_NUM>(cryptoText, entry.second.first);
+            solutionMap.insert(std::make_pair(entry.first, Solution(entry.second, decryptedText)));
+        }
+    }
+    auto recordProgress = [&]()
+    {
+        progress.rootIndex = rootIndex;
+        progress.pool.clear();
+        for(const auto& entry : solutionMap)
+        {
+            progress.pool.emplace_back(entry.first, entry.second.first);
+        }
+        std::ostringstream rngState;
+        rngState << rng;
+        progress.rngState = rngState.str();
+        checkpoint->updateClimb(progress);
+    };
+    while (!control.isStopped() && solutionMap.size() < GOOD_SOLUTION_NUM)
+    {
+        if (checkpoint && checkpoint->isSaveDue())
+        {
+            recordProgress();
+        }
+        if (!solutionMap.empty() && scorer.isSolved(cryptoText, solutionMap.rbegin()->second.first.first, solutionMap.rbegin()->first,
+                                                    decryptedText))
+        {
+            break;
+        }
+        CryptoKeySet bestKeys = getBestKeys<ALPHABET_LETTERS_NUM>(solutionMap, 1, activeLetters, rng);
+        const CryptoKeyData keyData(*bestKeys.begin(), 0);
+        const double quality = scorer.score(cryptoText, keyData.first, decryptedText);
+        control.offer(keyData.first, quality);
+        if (scorer.isSolved(cryptoText, keyData.first, quality, decryptedText))
+        {
+            // no mutation can improve it, for example a key given by the known letters
+            const TextView decryptedView = decryptedText.view();
+            solutionMap.insert(std::make_pair(quality, Solution(keyData, CryptoText(decryptedView.data(), decryptedView.size()))));
+            break;
+        }
+        addOneBetterSolution<SizeClass, Scorer, Mutator, Acceptor>(solutionMap, keyData, cryptoText, scorer, mutator, activeLetters, rng,
+                                                                   &control, seenKeys);
+    }
+    for (auto it = solutionMap.rbegin(); it != solutionMap.rend(); ++it)
+    {
+        if (scorer.isSolved(cryptoText, it->second.first.first, it->first, decryptedText))
+        {
+            retVal.emplace_back(it->second.first.first);
+        }
+    }
+    if (checkpoint)
+    {
+        recordProgress();
+    }
+    control.getMetrics().climbMs += getElapsedMs(tpClimb);
+    return retVal;
+}
+
+// The instantiations of every mutation and acceptance, indexed in the order of the enums
+template<TextSizeClass SizeClass, typename Scorer>
+ClimbFunction getPolicyClimbFunction(const SolverOptions& options)
+{
+    using Frequency = FrequencyMutator<ALPHABET_LETTERS_NUM>;
+    using Uniform = UniformMutator<ALPHABET_LETTERS_NUM>;
+    static const ClimbFunction climbFunctions[2][2] = {
+        {
+            &climbKeys<SizeClass, Scorer, Frequency, RandomWalkAcceptor>,
+            &climbKeys<SizeClass, Scorer, Frequency, PlateauAcceptor>
+        },
+        {
+            &climbKeys<SizeClass, Scorer, Uniform, RandomWalkAcceptor>,
+            &climbKeys<SizeClass, Scorer, Uniform, PlateauAcceptor>
+        }
+    };
+    return climbFunctions[static_cast<size_t>(options.climbMutation)][static_cast<size_t>(options.climbAcceptance)];
+}
+
+// Picked once per climb, the walks themselves call no function pointer. Patristocrats are
+// scored by segmentation, everything else by its words.
+ClimbFunction getClimbFunction(TextSizeClass sizeClass, const SolverOptions& options)
+{
+    if (options.mode == SolverMode::Patristocrat)
+    {
+        return sizeClass == TextSizeClass::Short
+            ? getPolicyClimbFunction<TextSizeClass::Short, SegmentationScorer>(options)
+            : getPolicyClimbFunction<TextSizeClass::Long, SegmentationScorer>(options);
+    }
+    return sizeClass == TextSizeClass::Short
+        ? getPolicyClimbFunction<TextSizeClass::Short, WordQualityScorer>(options)
+        : getPolicyClimbFunction<TextSizeClass::Long, WordQualityScorer>(options);
+}
+
+Dictionary createDictionary(const std::vector<std::string>& fileNames)
+{
+    Dictionary retVal;
+    for(const std::string& fileName : fileNames)
+    {
+        retVal.emplace_back(new DictionaryTier());
+        retVal.back()->fileName = fileName;
+    }
+    return retVal;
+}
+
+// Thread-safe, concurrent callers wait for the one that loads the tier
+const DictionaryTier& loadDictionaryTier(const Dictionary& dictionary, size_t tierIndex)
+{
+    DictionaryTier& tier = *dictionary[tierIndex];
+    std::call_once(tier.loadOnce, [&]()
+    {
+        WordRank firstRank = 0;
+        if (tierIndex > 0)
+        {
+            const DictionaryTier& previousTier = loadDictionaryTier(dictionary, tierIndex - 1);
+            tier.version = previousTier.version;
+            tier.wordList = previousTier.wordList;
+            tier.letterFrequencies = previousTier.letterFrequencies;
+            for(const WordList::value_type& entry : previousTier.wordList)
+            {
+                firstRank = std::max(firstRank, entry.second + 1);
+            }
+        }
+        auto tpBegin = std::chrono::steady_clock::now();
+        loadWordListIntoSet(tier.fileName, tier.wordList, tier.letterFrequencies, firstRank, &tier.version);
+        tier.loadMs = getElapsedMs(tpBegin);
+        tpBegin = std::chrono::steady_clock::now();
+        tier.patternMap = createPatternMap(tier.wordList);
+        tier.patternMapMs = getElapsedMs(tpBegin);
+        tier.loaded = true;
+    });
+    return tier;
+}
+
+// Every word gets the candidates of the smallest tier from firstTier on that has any. The
+// words are views into text, which has to outlive the result. The candidates of a pattern
+// come from cache if it has them. metrics, if given, gets the candidates and time of every word.
+CryptogramWords prepareCryptogramWords(TextView text, const Dictionary& dictionary, size_t firstTier, PatternCandidateCache* cache,
+                                       SolverMetrics* metrics)
+{
+    CryptogramWords retVal;
+    retVal.numWords = splitLineToWords(text, retVal.words);
+    retVal.keysPerWord.resize(retVal.numWords);
+    retVal.ranksPerWord.resize(retVal.numWords);
+    retVal.wildcardWords.resize(retVal.numWords, false);
+    retVal.dictionaryTier = firstTier;
+    const auto tpPrepare = std::chrono::steady_clock::now();
+    for(size_t index = 0; index < retVal.numWords; ++index)
+    {
+        const auto tpWord = std::chrono::steady_clock::now();
+        TextView& word = retVal.words[index];
+        retVal.positionsPerWord.emplace_back(getWordLetterPositions(word));
+        if (word.size() > maxWordLength)
+        {
+            // longer than any dictionary word, stays without candidates
+            continue;
+        }
+        // apostrophes around the word may be quotation marks, the word without them is the
+        // second choice in every tier
+        const TextView choices[] = {word, trimApostrophes(word)};
+        const size_t numChoices = choices[1].size() != word.size() ? 2 : 1;
+        for(size_t tierIndex = firstTier; tierIndex < dictionary.size() && retVal.keysPerWord[index].empty(); ++tierIndex)
+        {
+            const DictionaryTier& tier = loadDictionaryTier(dictionary, tierIndex);
+            for(size_t choice = 0; choice < numChoices; ++choice)
+            {
+                const Word pattern = getWordPattern(choices[choice]);
+                const std::shared_ptr<const PatternCandidates> candidates = getPatternCandidates(tier, pattern, cache);
+                if (!candidates->keys.empty())
+                {
+                    retVal.keysPerWord[index] = translatePatternKeys(choices[choice], pattern, candidates->keys);
+                    retVal.ranksPerWord[index] = candidates->ranks;
+                }
+                if (!retVal.keysPerWord[index].empty())
+                {
+                    word = choices[choice];
+                    retVal.dictionaryTier = std::max(retVal.dictionaryTier, tierIndex);
+                    break;
+                }
+            }
+        }
+        if (metrics)
+        {
+            metrics->words.emplace_back();
+            metrics->words.back().word = index;
+            metrics->words.back().candidates = retVal.keysPerWord[index].size();
+            metrics->words.back().ms = getElapsedMs(tpWord);
+            metrics->candidateWords += retVal.keysPerWord[index].empty() ? 0 : 1;
+        }
+    }
+    if (metrics)
+    {
+        metrics->candidateMs += getElapsedMs(tpPrepare);
+    }
+    return retVal;
+}
+
+// The share of shardIndex of the candidates of the first planned word, every shardCount-th
+// from shardIndex on, so each shard gets common and rare words alike
+CryptogramWords selectShard(const CryptogramWords& cryptogram, size_t shardIndex, size_t shardCount)
+{
+    CryptogramWords retVal = cryptogram;
+    const Combination order = planWordOrder(cryptogram);
+    if (order.empty())
+    {
+        return retVal;
+    }
+    const int word = order.front();
+    retVal.keysPerWord[word].clear();
+    retVal.ranksPerWord[word].clear();
+    for(size_t index = shardIndex; index < cryptogram.keysPerWord[word].size(); index += shardCount)
+    {
+        retVal.keysPerWord[word].emplace_back(cryptogram.keysPerWord[word][index]);
+        retVal.ranksPerWord[word].emplace_back(cryptogram.ranksPerWord[word][index]);
+    }
+    return retVal;
+}
+
+CryptoKeyList searchKeys(const CryptogramWords& cryptogram, const WordList& wordList, const SolverOptions& options, size_t maxKeys,
+                         const SolutionCallback& onSolution, SearchControl& control)
+{
+    CryptoKeyList retVal;
+    if (options.shardCount > 1)
+    {
+        SolverOptions shardOptions = options;
+        shardOptions.shardCount = 1;
+        return searchKeys(selectShard(cryptogram, options.shardIndex, options.shardCount), wordList, shardOptions, maxKeys, onSolution, control);
+    }
+    control.setWordList(&wordList);
+    if (options.mode == SolverMode::BestFirst)
+    {
+        retVal = bestFirstSearchKeys(cryptogram, planWordOrder(cryptogram), wordList, options.maxSolutions, maxKeys, onSolution, control);
+    }
+    else if (options.mode == SolverMode::Beam)
+    {
+        retVal = beamSearchKeys(cryptogram, planWordOrder(cryptogram), wordList, options.beamWidth, maxKeys, control);
+    }
+    else
+    {
+        retVal = combineKeysSmart(cryptogram, maxKeys, &control);
+    }
+    return retVal;
+}
+
+// Words without any dictionary match are always unknown, unknownWords are unknown as well.
+// Nothing is searched when that makes more than maxUnknownWords.
+CryptoKeyList searchKeysWithUnknownWords(CryptogramWords& cryptogram, const WordList& wordList, const SolverOptions& options,
+                                         const std::vector<size_t>& unknownWords, size_t maxKeys, const SolutionCallback& onSolution,
+                                         SearchControl& control)
+{
+    CryptoKeyList retVal;
+    size_t numUnknownWords = 0;
+    for(size_t index = 0; index < cryptogram.numWords; ++index)
+    {
+        cryptogram.wildcardWords[index] = cryptogram.keysPerWord[index].empty();
+        if (cryptogram.wildcardWords[index])
+        {
+            logMessage(LogLevel::Info, "Word {} has no dictionary match\n", cryptogram.words[index]);
+            ++numUnknownWords;
+        }
+    }
+    std::string unknownList;
+    for(size_t word : unknownWords)
+    {
+        if (word < cryptogram.numWords && !cryptogram.wildcardWords[word])
+        {
+            cryptogram.wildcardWords[word] = true;
+            ++numUnknownWords;
+            unknownList.append(" ").append(cryptogram.words[word].data(), cryptogram.words[word].size());
+        }
+    }
+    if (numUnknownWords > options.maxUnknownWords)
+    {
+        logMessage(LogLevel::Info, "{} words are unknown, only {} allowed\n", numUnknownWords, options.maxUnknownWords);
+        return retVal;
+    }
+    if (!unknownList.empty())
+    {
+        logMessage(LogLevel::Info, "Treating as unknown:{}\n", unknownList);
+    }
+    retVal = searchKeys(cryptogram, wordList, options, maxKeys, onSolution, control);
+    return retVal;
+}
+
+// The pass after inOutPass of a solve whose pass on cryptogram found nothing. The smaller
+// tiers are widened to the last one first. Then more words are treated as unknown, picked
+// from the least constrained ones (fewest letters shared with the other words, most
+// candidates) so the remaining join keeps most of its pruning: every subset of the pool of
+// the maxUnknownWords + 2 least constrained words in lexicographic order, one word first,
+// then two and so on while the budget allows. false after the last pass.
+bool getNextSearchPass(const CryptogramWords& cryptogram, size_t lastTier, size_t maxUnknownWords, SearchPass& inOutPass)
+{
+    if (inOutPass.tier < lastTier)
+    {
+        inOutPass.tier = lastTier;
+        inOutPass.unknownWords.clear();
+        return true;
+    }
+    std::vector<int> knownWords;
+    for(size_t index = 0; index < cryptogram.numWords; ++index)
+    {
+        if (!cryptogram.keysPerWord[index].empty())
+        {
+            knownWords.emplace_back(index);
+        }
+    }
+    const size_t noMatchWords = cryptogram.numWords - knownWords.size();
+    if (noMatchWords >= maxUnknownWords || knownWords.size() < 2)
+    {
+        return false;
+    }
+    std::vector<int> sharedLetters(cryptogram.numWords, 0);
+    for(int word1 : knownWords)
+    {
+        for(int word2 : knownWords)
+        {
+            if (word1 != word2)
+            {
+                sharedLetters[word1] += getNumberOfCommonLetters(cryptogram.positionsPerWord[word1], cryptogram.positionsPerWord[word2]);
+            }
+        }
+    }
+    std::stable_sort(knownWords.begin(), knownWords.end(), [&](int word1, int word2) -> bool
+    {
+        if (sharedLetters[word1] != sharedLetters[word2])
+        {
+            return sharedLetters[word1] < sharedLetters[word2];
+        }
+        return cryptogram.keysPerWord[word1].size() > cryptogram.keysPerWord[word2].size();
+    });
+    const size_t extraBudget = std::min(maxUnknownWords - noMatchWords, knownWords.size() - 1);
+    const size_t poolSize = std::min(knownWords.size(), maxUnknownWords + 2);
+
+    // the positions of the unknown words in the pool, then the next subset
+    Combination subset;
+    for(size_t word : inOutPass.unknownWords)
+    {
+        const auto found = std::find(knownWords.begin(), knownWords.begin() + poolSize, static_cast<int>(word));
+        if (found == knownWords.begin() + poolSize)
+        {
+            return false;
+        }
+        subset.emplace_back(static_cast<int>(found - knownWords.begin()));
+    }
+    std::sort(subset.begin(), subset.end());
+    const int extra = static_cast<int>(subset.size());
+    int position = extra - 1;
+    while (position >= 0 && subset[position] == static_cast<int>(poolSize) - extra + position)
+    {
+        --position;
+    }
+    if (position >= 0)
+    {
+        ++subset[position];
+        for(int index = position + 1; index < extra; ++index)
+        {
+            subset[index] = subset[index - 1] + 1;
+        }
+    }
+    else
+    {
+        // all subsets of this size were tried, one word more
+        if (static_cast<size_t>(extra) + 1 > std::min(extraBudget, poolSize))
+        {
+            return false;
+        }
+        subset.resize(extra + 1);
+        for(size_t index = 0; index < subset.size(); ++index)
+        {
+            subset[index] = static_cast<int>(index);
+        }
+    }
+    inOutPass.unknownWords.clear();
+    for(int poolIndex : subset)
+    {
+        inOutPass.unknownWords.emplace_back(knownWords[poolIndex]);
+    }
+    return true;
+}
+
+// Root partial keys of the search: the known letters merged with every placement of the
+// cribs that fits the words of the text, at most maxRootKeys of them. Fails if the known
+// letters are no valid partial key, a crib fits nowhere or they contradict each other.
+bool getRootKeys(TextView text, const SolverOptions& options, CryptoKeyList& outRootKeys, std::string& outError)
+{
+    constexpr size_t maxRootKeys = 1000;
+    CryptoKey knownKey = getInitialKey();
+    if (!options.knownKey.empty())
+    {
+        std::string upperKnownKey = options.knownKey;
+        std::transform(upperKnownKey.begin(), upperKnownKey.end(), upperKnownKey.begin(), ::toupper);
+        bool valid = upperKnownKey.size() == ALPHABET_LETTERS_NUM;
+        for(size_t index = 0; valid && index < upperKnownKey.size(); ++index)
+        {
+            valid = upperKnownKey[index] == '*' || isCipherLetter(upperKnownKey[index]);
+        }
+        // a plain letter for two cipher letters does not merge
+        if (!valid || !mergeTwoKeys(CryptoKey(upperKnownKey), getInitialKey(), knownKey))
+        {
+            outError = "the known key needs a plain letter or '*' for each of the 26 cipher letters, each plain letter once";
+            return false;
+        }
+    }
+    outRootKeys.assign(1, knownKey);
+
+    WordSpans words;
+    splitLineToWords(text, words);
+    for(const Crib& crib : options.cribs)
+    {
+        std::string plaintext = crib.plaintext;
+        std::transform(plaintext.begin(), plaintext.end(), plaintext.begin(), ::toupper);
+        WordSpans cribWords;
+        splitLineToWords(plaintext, cribWords);
+        CryptoKeyList placements;
+        const size_t firstWord = crib.wordIndex >= 0 ? static_cast<size_t>(crib.wordIndex) : 0;
+        const size_t lastWord = crib.wordIndex >= 0 ? firstWord : words.size();
+        for(size_t wordIndex = firstWord; !cribWords.empty() && wordIndex <= lastWord && wordIndex + cribWords.size() <= words.size(); ++wordIndex)
+        {
+            CryptoKey key = getInitialKey();
+            bool fits = true;
+            for(size_t index = 0; fits && index < cribWords.size(); ++index)
+            {
+                const TextView& cipherWord = words[wordIndex + index];
+                CryptoKey merged(getInitialKey());
+                fits = cipherWord.size() <= maxWordLength && getWordPattern(cipherWord) == getWordPattern(cribWords[index])
+                    && mergeTwoKeys(key, getCommonKeyFromTwoWords(cipherWord, Word(cribWords[index].data(), cribWords[index].size())), merged);
+                key = merged;
+            }
+            if (fits)
+            {
+                placements.emplace_back(key);
+            }
+        }
+        if (placements.empty())
+        {
+            outError = "the crib " + crib.plaintext + (crib.wordIndex >= 0 ? " does not fit at word " + std::to_string(crib.wordIndex) : " fits no words of the text");
+            return false;
+        }
+
+        CryptoKeyList rootKeys;
+        CryptoKeySet uniqueKeys;
+        for(const CryptoKey& rootKey : outRootKeys)
+        {
+            for(const CryptoKey& placement : placements)
+            {
+                CryptoKey merged(getInitialKey());
+                if (rootKeys.size() < maxRootKeys && mergeTwoKeys(rootKey, placement, merged) && uniqueKeys.insert(merged).second)
+                {
+                    rootKeys.emplace_back(merged);
+                }
+            }
+        }
+        if (rootKeys.empty())
+        {
+            outError = "the known letters and cribs contradict each other";
+            return false;
+        }
+        outRootKeys.swap(rootKeys);
+    }
+    return true;
+}
+
+// Only the candidates that agree with rootKey remain, merged with it, so every key the
+// engines join from them contains the root. A word left without candidates is unknown.
+CryptogramWords constrainCryptogramWords(const CryptogramWords& cryptogram, const CryptoKey& rootKey)
+{
+    CryptogramWords retVal;
+    retVal.words = cryptogram.words;
+    retVal.numWords = cryptogram.numWords;
+    retVal.positionsPerWord = cryptogram.positionsPerWord;
+    retVal.wildcardWords = cryptogram.wildcardWords;
+    retVal.dictionaryTier = cryptogram.dictionaryTier;
+    retVal.keysPerWord.resize(cryptogram.numWords);
+    retVal.ranksPerWord.resize(cryptogram.numWords);
+    for(size_t wordIndex = 0; wordIndex < cryptogram.numWords; ++wordIndex)
+    {
+        const CryptoKeyList& keys = cryptogram.keysPerWord[wordIndex];
+        for(size_t index = 0; index < keys.size(); ++index)
+        {
+            CryptoKey merged(getInitialKey());
+            if (mergeTwoKeys(rootKey, keys[index], merged))
+            {
+                retVal.keysPerWord[wordIndex].emplace_back(merged);
+                retVal.ranksPerWord[wordIndex].emplace_back(cryptogram.ranksPerWord[wordIndex][index]);
+            }
+        }
+    }
+    return retVal;
+}
+
+// The search once for every root key, on the candidates that agree with it. Without known
+// letters or cribs the only root is the empty key and the candidates stay as they are.
+CryptoKeyList searchKeysFromRoots(const CryptogramWords& cryptogram, const CryptoKeyList& rootKeys, const WordList& wordList,
+                                  const SolverOptions& options, const std::vector<size_t>& unknownWords, size_t maxKeys,
+                                  const SolutionCallback& onSolution, SearchControl& control)
+{
+    CryptoKeyList retVal;
+    for(const CryptoKey& rootKey : rootKeys)
+    {
+        if (control.isStopped())
+        {
+            break;
+        }
+        CryptogramWords constrained = rootKey == getInitialKey() ? cryptogram : constrainCryptogramWords(cryptogram, rootKey);
+        const CryptoKeyList keys = searchKeysWithUnknownWords(constrained, wordList, options, unknownWords, maxKeys, onSolution, control);
+        retVal.insert(retVal.end(), keys.begin(), keys.end());
+    }
+    return retVal;
+}
+
+// The first pass takes every word from the smallest tier that has candidates for it. While
+// a pass finds no full key the search goes on with the next one, see getNextSearchPass:
+// all words widened to the largest tier, then more and more unknown words. The passes are
+// the same for all root keys of the known letters and cribs, and a shard only searches
+// options.shardPass and returns the pass after it, so the caller widens all shards alike.
+CryptoKeyList searchKeysInTiers(TextView text, const Dictionary& dictionary, const SolverOptions& options, const CryptoKeyList& rootKeys,
+                                size_t maxKeys, const SolutionCallback& onSolution, SearchControl& control, size_t& outTier,
+                                bool& outHasNextPass, SearchPass& outNextPass)
+{
+    CryptoKeyList retVal;
+    const size_t lastTier = dictionary.size() - 1;
+    outHasNextPass = false;
+    if (options.mode == SolverMode::Climb || options.mode == SolverMode::Patristocrat)
+    {
+        // the climber scores whole texts, the small wordlist keeps rare words from scoring
+        const DictionaryTier& tier = loadDictionaryTier(dictionary, 0);
+        outTier = 0;
+        control.setWordList(&tier.wordList);
+        // one tabu filter for the climbs from all roots
+        std::unique_ptr<SeenKeyFilter> seenKeys;
+        if (options.seenKeyFilterKB > 0)
+        {
+            seenKeys.reset(new SeenKeyFilter(options.seenKeyFilterKB * 1024));
+        }
+        // a resumed climb starts at the root it was climbing from
+        ClimbProgress progress;
+        const size_t firstRoot = control.getCheckpoint() && control.getCheckpoint()->getClimb(progress) ? progress.rootIndex : 0;
+        const ClimbFunction climb = getClimbFunction(getTextSizeClass(text.size()), options);
+        // the climbs of a shard are reproducible and differ from the other shards
+        std::random_device randomDevice;
+        const unsigned int seed = options.shardCount > 1 ? static_cast<unsigned int>(options.shardIndex) : randomDevice();
+        for(size_t rootIndex = firstRoot; rootIndex < rootKeys.size() && retVal.empty() && !control.isStopped(); ++rootIndex)
+        {
+            retVal = climb(text, tier, control, rootKeys[rootIndex], seenKeys.get(), rootIndex, seed);
+        }
+        return retVal;
+    }
+    const bool sharded = options.shardCount > 1;
+    SearchPass pass = sharded ? options.shardPass : SearchPass();
+    pass.tier = std::min(pass.tier, lastTier);
+    CryptogramWords cryptogram = prepareCryptogramWords(text, dictionary, pass.tier, control.getCandidateCache(), &control.getMetrics());
+    while (true)
+    {
+        outTier = cryptogram.dictionaryTier;
+        retVal = searchKeysFromRoots(cryptogram, rootKeys, dictionary[outTier]->wordList, options, pass.unknownWords, maxKeys, onSolution, control);
+        const size_t passTier = pass.tier;
+        const bool hasNextPass = getNextSearchPass(cryptogram, lastTier, options.maxUnknownWords, pass);
+        if (sharded)
+        {
+            outHasNextPass = hasNextPass;
+            outNextPass = pass;
+            break;
+        }
+        if (!retVal.empty() || control.isStopped() || !hasNextPass)
+        {
+            break;
+        }
+        if (pass.tier != passTier)
+        {
+            logMessage(LogLevel::Info, "No solution in the smaller dictionary tiers, widening all words to {}\n", dictionary[pass.tier]->fileName);
+            cryptogram = prepareCryptogramWords(text, dictionary, pass.tier, control.getCandidateCache(), &control.getMetrics());
+        }
+    }
+    return retVal;
+}
+
+// The engines substitute upper case letters and keep everything else in place, so any text
+// with at least one word can be searched
+bool isSupportedCryptogram(const std::string& text)
+{
+    TextView word;
+    return WordTokenizer(text).next(word);
+}
@@ -0,0 +1,1179 @@
+#ifndef _SOLVERENGINE_H_
+#define _SOLVERENGINE_H_
+
+// Search engines behind the Solver of fastcryptosolver.h. Not part of the public
+// interface, the command line tool and the benchmarks use it directly.
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <set>
+#include <unordered_map>
+#include <map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <functional>
+#include <memory>
+#include <limits>
+#include <chrono>
+#include <ostream>
+#include <string.h>
+#include <assert.h>
+#include "MurmurHash3.h"
+#include "boost/multi_array.hpp"
+#include "fastcryptosolver.h"
+#include "solverlog.h"
+
+constexpr unsigned int ALPHABET_LETTERS_NUM = 26;
+constexpr unsigned int GOOD_SOLUTION_NUM = 1000;
+constexpr double SOLUTION_QUALITY = 0.7;
+constexpr unsigned int maxWordLength = 70;
+constexpr size_t maxShortTextLength = 128;
+constexpr int mutateGoodLetterFactor = 20;
+constexpr unsigned int keyTryLimit = 80000000u;
+
+
+template<int maxLen>
+class FixedString
+{
+    static constexpr int arrSize = maxLen + 1;
+public:
+    FixedString() : currentLen(0)
+    {
+        memset(array, 0, arrSize);
+    }
+
+    FixedString(const std::string& original) : FixedString(original.data(), original.size())
+    {
+    }
+
+    // longer input is cut at maxLen
+    FixedString(const char* data, size_t length) : currentLen(std::min<size_t>(length, maxLen))
+    {
+        memset(array, 0, arrSize);
+        memcpy(array, data, currentLen);
+    }
+
+    FixedString(const char * cStr)
+    {
+        memset(array, 0, arrSize);
+        if(cStr)
+        {
+            currentLen = strnlen(cStr, maxLen);
+            memcpy(array, cStr, currentLen);
+        }
+        else
+        {
+            currentLen = 0;
+        }
+    }
+    ~FixedString(){}
+
+    inline const char * c_str() const
+    {
+        return array;
+    }
+
+    inline const char& at(size_t offset) const
+    {
+        assert(offset >= 0);
+        assert(offset < maxLen);
+        return array[offset];
+    }
+
+    inline char& at(size_t offset)
+    {
+        return array[offset];
+    }
+
+    inline size_t size() const
+    {
+        return currentLen;
+    }
+
+    // only the characters of the string, a short word does not pay for the whole array
+    struct hasher
+    {
+        size_t operator()( const FixedString<maxLen>& objToHash ) const
+        {
+            return hash(objToHash.array, objToHash.currentLen);
+        }
+
+        // same value for the same characters held anywhere else
+        static uint32_t hash(const char* data, size_t length)
+        {
+            uint32_t retVal;
+            MurmurHash3_x86_32(data, static_cast<int>(length), 0xDEADBEEF, &retVal);
+            return retVal;
+        }
+    };
+
+    inline bool operator==(const FixedString<maxLen>& other) const
+    {
+        return currentLen == other.currentLen && (memcmp(array, other.array, currentLen) == 0);
+    }
+
+    inline void operator=(const FixedString<maxLen> &other )
+    {
+        memcpy(array, other.array, arrSize);
+        currentLen = other.currentLen;
+    }
+
+    inline size_t find_first_of(const char val, size_t offset = 0) const
+    {
+        size_t retVal = npos;
+        if(offset <= currentLen)
+        {
+            for(size_t index = offset; index < currentLen; ++index)
+            {
+                if(val == array[index])
+                {
+                    retVal = index;
+                    break;
+                }
+            }
+        }
+        return retVal;
+    }
+
+    inline void push_back(char chr)
+    {
+        array[currentLen] = chr;
+        currentLen++;
+    }
+
+    inline FixedString<maxLen> substr(size_t begin, size_t len) const
+    {
+        FixedString<maxLen> retVal;
+        assert(begin + len < arrSize);
+        memset(retVal.array, 0, arrSize);
+        memcpy(retVal.array, &array[begin], len);
+        retVal.currentLen = len;
+        return retVal;
+    }
+
+    inline size_t count(const char val) 
+    {
+        size_t retVal = 0;
+        for (size_t index = 0; index < currentLen; ++index) 
+        {
+            if (array[index] == val) 
+            {
+                ++retVal;
+            }
+        }
+        return retVal;
+    }
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    size_t currentLen;
+    alignas(16) char array[arrSize];
+};
+
+
+
+// Non-owning view of a text or of one of its words. The engines work on views into the
+// cryptogram, so neither the text nor its words are copied.
+class TextView
+{
+public:
+    TextView() : ptr(""), length(0) {}
+    TextView(const char* data, size_t length) : ptr(data), length(length) {}
+    TextView(const std::string& text) : ptr(text.data()), length(text.size()) {}
+    template<int maxLen>
+    TextView(const FixedString<maxLen>& text) : ptr(text.c_str()), length(text.size()) {}
+
+    inline const char* data() const
+    {
+        return ptr;
+    }
+
+    inline size_t size() const
+    {
+        return length;
+    }
+
+    inline const char& at(size_t offset) const
+    {
+        assert(offset < length);
+        return ptr[offset];
+    }
+
+    inline TextView substr(size_t begin, size_t len) const
+    {
+        assert(begin + len <= length);
+        return TextView(ptr + begin, len);
+    }
+
+private:
+    const char* ptr;
+    size_t length;
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const TextView& text)
+{
+    return stream.write(text.data(), text.size());
+}
+
+inline bool isCipherLetter(char chr)
+{
+    return chr >= 'A' && chr <= 'Z';
+}
+
+// Single pass over the words of a text. A word is a run of letters and apostrophes with at
+// least one letter, everything else (runs of whitespace, punctuation, digits) separates
+// words and stays fixed in place. The words are views into the text, nothing is allocated.
+class WordTokenizer
+{
+public:
+    explicit WordTokenizer(TextView text) : text(text), offset(0) {}
+
+    bool next(TextView& outWord)
+    {
+        while (offset < text.size())
+        {
+            while (offset < text.size() && !isWordCharacter(text.at(offset)))
+            {
+                ++offset;
+            }
+            const size_t wordBegin = offset;
+            bool hasLetter = false;
+            while (offset < text.size() && isWordCharacter(text.at(offset)))
+            {
+                hasLetter = hasLetter || isCipherLetter(text.at(offset));
+                ++offset;
+            }
+            if (hasLetter)
+            {
+                outWord = text.substr(wordBegin, offset - wordBegin);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static bool isWordCharacter(char chr)
+    {
+        return isCipherLetter(chr) || chr == '\'';
+    }
+
+    TextView text;
+    size_t offset;
+};
+
+// The word without leading and trailing apostrophes, which may be quotation marks
+inline TextView trimApostrophes(TextView word)
+{
+    size_t begin = 0;
+    size_t end = word.size();
+    while (begin < end && word.at(begin) == '\'')
+    {
+        ++begin;
+    }
+    while (end > begin && word.at(end - 1) == '\'')
+    {
+        --end;
+    }
+    return word.substr(begin, end - begin);
+}
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& fileName);
+    ~MappedFile();
+
+    bool isOpen() const
+    {
+        return opened;
+    }
+
+    TextView view() const
+    {
+        return opened && mapping ? TextView(static_cast<const char*>(mapping), size) : TextView();
+    }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void* mapping = nullptr;
+    size_t size = 0;
+    bool opened = false;
+};
+
+// Buffers for decoded texts, specialized on the size class of the text: short texts stay
+// on the stack, long ones get one heap buffer that is reused for every key
+enum class TextSizeClass
+{
+    Short,
+    Long
+};
+
+inline TextSizeClass getTextSizeClass(size_t length)
+{
+    return length <= maxShortTextLength ? TextSizeClass::Short : TextSizeClass::Long;
+}
+
+template<TextSizeClass SizeClass>
+class TextBuffer;
+
+template<>
+class TextBuffer<TextSizeClass::Short>
+{
+public:
+    explicit TextBuffer(size_t length) : length(length)
+    {
+        assert(length <= maxShortTextLength);
+    }
+
+    inline char* data()
+    {
+        return storage.data();
+    }
+
+    inline TextView view() const
+    {
+        return TextView(storage.data(), length);
+    }
+
+private:
+    std::array<char, maxShortTextLength> storage;
+    size_t length;
+};
+
+template<>
+class TextBuffer<TextSizeClass::Long>
+{
+public:
+    explicit TextBuffer(size_t length) : storage(length) {}
+
+    inline char* data()
+    {
+        return storage.data();
+    }
+
+    inline TextView view() const
+    {
+        return TextView(storage.data(), storage.size());
+    }
+
+private:
+    std::vector<char> storage;
+};
+
+//using Word = std::string;
+//using WordList = std::unordered_set<std::string>;
+using Word = FixedString<maxWordLength>;
+// every word keeps its line number, the wordlists are sorted by frequency
+using WordRank = unsigned int;
+using WordRankList = std::vector<WordRank>;
+
+// Flat hash map from the words to their rank. The entries are stored densely in insertion
+// order and the open addressing table holds their hash and index, so a lookup touches one
+// table slot and one entry. Words are never removed.
+class WordList
+{
+public:
+    using value_type = std::pair<Word, WordRank>;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    void reserve(size_t count)
+    {
+        entries.reserve(count);
+        size_t tableSize = minTableSize;
+        while (tableSize < count * 2)
+        {
+            tableSize *= 2;
+        }
+        if (tableSize > table.size())
+        {
+            rehash(tableSize);
+        }
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    const_iterator begin() const
+    {
+        return entries.begin();
+    }
+
+    const_iterator end() const
+    {
+        return entries.end();
+    }
+
+    // no Word is built for the lookup
+    const_iterator find(TextView word) const
+    {
+        return find(word, Word::hasher::hash(word.data(), word.size()));
+    }
+
+    const_iterator find(TextView word, uint32_t hash) const
+    {
+        if (table.empty())
+        {
+            return end();
+        }
+        for(size_t slot = hash & (table.size() - 1); table[slot].index != emptySlot; slot = (slot + 1) & (table.size() - 1))
+        {
+            const Word& entry = entries[table[slot].index].first;
+            if (table[slot].hash == hash && entry.size() == word.size() && memcmp(entry.c_str(), word.data(), word.size()) == 0)
+            {
+                return begin() + table[slot].index;
+            }
+        }
+        return end();
+    }
+
+    // a word that is already in the list keeps its rank
+    std::pair<const_iterator, bool> emplace(TextView word, WordRank rank)
+    {
+        return emplace(word, rank, Word::hasher::hash(word.data(), word.size()));
+    }
+
+    std::pair<const_iterator, bool> emplace(TextView word, WordRank rank, uint32_t hash)
+    {
+        const_iterator it = find(word, hash);
+        if (it != end())
+        {
+            return std::make_pair(it, false);
+        }
+        if ((entries.size() + 1) * 2 > table.size())
+        {
+            rehash(table.empty() ? minTableSize : table.size() * 2);
+        }
+        insertSlot(hash, static_cast<uint32_t>(entries.size()));
+        entries.emplace_back(Word(word.data(), word.size()), rank);
+        return std::make_pair(end() - 1, true);
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    static constexpr uint32_t emptySlot = std::numeric_limits<uint32_t>::max();
+    static constexpr size_t minTableSize = 16;
+
+    void insertSlot(uint32_t hash, uint32_t index)
+    {
+        size_t slot = hash & (table.size() - 1);
+        while (table[slot].index != emptySlot)
+        {
+            slot = (slot + 1) & (table.size() - 1);
+        }
+        table[slot].hash = hash;
+        table[slot].index = index;
+    }
+
+    void rehash(size_t tableSize)
+    {
+        std::vector<Slot> oldTable(tableSize, Slot{0, emptySlot});
+        oldTable.swap(table);
+        for(const Slot& slot : oldTable)
+        {
+            if (slot.index != emptySlot)
+            {
+                insertSlot(slot.hash, slot.index);
+            }
+        }
+    }
+
+    std::vector<value_type> entries;
+    std::vector<Slot> table;        // size is a power of two, at most half full
+};
+
+using WordPatternMap = std::unordered_map<Word, WordList, Word::hasher>;
+using WordSpans = std::vector<TextView>;
+using CryptoText = std::string;         // owned cryptogram or decoded text, the engines take views
+using CryptoKey = FixedString<ALPHABET_LETTERS_NUM>;
+using CryptoKeyList = std::vector<CryptoKey>;
+using CryptoKeySet = std::unordered_set<CryptoKey, CryptoKey::hasher>;
+using CryptoKeyData = std::pair<CryptoKey, unsigned int>;
+using Solution = std::pair<CryptoKeyData, const CryptoText>;
+using SolutionMap = std::multimap<double, Solution>;
+using LetterFrequencyMap = std::map<char, unsigned int>;
+using LetterCounts = std::array<unsigned int, ALPHABET_LETTERS_NUM>;
+using Combination = std::vector<int>;
+using CombinationList = std::vector<Combination>;
+using Matrix2D = boost::multi_array<int, 2>;
+using LetterPositions = std::vector<unsigned int>;
+
+// Cipher letters that actually occur in the text. Key positions outside of this set
+// never reach transformText, so the engines only mutate and compare the active ones.
+struct ActiveLetters
+{
+    std::array<bool, ALPHABET_LETTERS_NUM> present;
+    std::vector<unsigned int> positions;        // present and not fixed
+    CryptoKey fixedKey;                         // letters no mutation may change, '*' for the others
+};
+
+// Everything the search engines need to know about the words of one cryptogram
+struct CryptogramWords
+{
+    WordSpans words;                    // views into the cryptogram
+    size_t numWords = 0;
+    std::vector<CryptoKeyList> keysPerWord;
+    std::vector<WordRankList> ranksPerWord;
+    std::vector<LetterPositions> positionsPerWord;
+    std::vector<bool> wildcardWords;    // unknown words, skipped by the join
+    size_t dictionaryTier = 0;          // widest dictionary tier the candidates come from
+};
+
+using ScoredKey = std::pair<double, CryptoKey>;
+
+struct ScoredKeyGreater
+{
+    bool operator()(const ScoredKey& key1, const ScoredKey& key2) const
+    {
+        return key1.first > key2.first;
+    }
+};
+
+using SolutionCallback = std::function<void(const CryptoKey& key, double cost)>;
+
+inline double getElapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count() / 1000.0;
+}
+
+// Deadline, cancellation and the best key so far of one solve. The engines poll
+// shouldStop in their loops and offer the keys that may beat the best one, which is
+// scored by the quality of its decoded text against the current word list.
+class SearchControl
+{
+public:
+    using ImprovementCallback = std::function<void(const CryptoKey& key, double quality)>;
+
+    SearchControl() {}
+    SearchControl(const SolverOptions& options, TextView text, ImprovementCallback onImprovement);
+
+    // the clock is only read every checkInterval calls
+    bool shouldStop()
+    {
+        if (!stopped && (hasDeadline || cancellation) && ++pollCount % checkInterval == 0)
+        {
+            stopped = (cancellation && cancellation->isCancelled())
+                || (hasDeadline && std::chrono::steady_clock::now() >= deadline);
+        }
+        return stopped;
+    }
+
+    bool isStopped() const
+    {
+        return stopped;
+    }
+
+    // a key list was cut at the memory limit, the keys of the solve may be incomplete
+    void markTruncated()
+    {
+        truncated = true;
+    }
+
+    bool isTruncated() const
+    {
+        return truncated;
+    }
+
+    void setWordList(const WordList* list)
+    {
+        wordList = list;
+    }
+
+    void setCandidateCache(PatternCandidateCache* cache)
+    {
+        candidateCache = cache;
+    }
+
+    PatternCandidateCache* getCandidateCache() const
+    {
+        return candidateCache;
+    }
+
+    void setCheckpoint(CheckpointStore* store)
+    {
+        checkpoint = store;
+    }
+
+    CheckpointStore* getCheckpoint() const
+    {
+        return checkpoint;
+    }
+
+    // counters of this solve, only touched by the thread running it
+    SolverMetrics& getMetrics()
+    {
+        return metrics;
+    }
+
+    void offer(const CryptoKey& key);
+    void offer(const CryptoKey& key, double quality);
+
+    bool hasBestKey() const
+    {
+        return bestQuality >= 0;
+    }
+
+    const CryptoKey& getBestKey() const
+    {
+        return bestKey;
+    }
+
+private:
+    static constexpr unsigned int checkInterval = 64;
+    bool hasDeadline = false;
+    std::chrono::steady_clock::time_point deadline;
+    std::shared_ptr<const CancellationToken> cancellation;
+    unsigned int pollCount = 0;
+    bool stopped = false;
+    bool truncated = false;
+    TextView text;
+    const WordList* wordList = nullptr;
+    PatternCandidateCache* candidateCache = nullptr;
+    CheckpointStore* checkpoint = nullptr;
+    ImprovementCallback onImprovement;
+    CryptoKey bestKey;
+    double bestQuality = -1.0;
+    SolverMetrics metrics;
+};
+
+// Dictionary tiers from the small, high precision wordlist to the large one. Every tier
+// holds its own words and the words of all smaller tiers, the ranks of a tier continue
+// after the ranks of the previous one. Tiers are loaded once, on first use.
+class SegmentationIndex;
+
+struct DictionaryTier
+{
+    std::string fileName;
+    uint64_t version = 0;       // hash of the content of this and all smaller tiers
+    WordList wordList;
+    WordPatternMap patternMap;
+    LetterFrequencyMap letterFrequencies;
+    double loadMs = 0.0;
+    double patternMapMs = 0.0;
+    std::atomic<bool> loaded{false};    // set after all members above
+    std::once_flag loadOnce;
+    mutable std::unique_ptr<SegmentationIndex> segmentation;   // built by the first patristocrat solve
+    mutable std::once_flag segmentationOnce;
+};
+
+using Dictionary = std::vector<std::unique_ptr<DictionaryTier>>;
+
+// Candidate keys of all dictionary words with one pattern, written in the letters of the
+// pattern itself ('A' for its first letter and so on), the most frequent word first
+struct PatternCandidates
+{
+    CryptoKeyList keys;
+    WordRankList ranks;
+};
+
+// LRU cache of the PatternCandidates of a dictionary tier version and a pattern, behind
+// CandidateCache. Misses in memory fall back to the index of a mapped cache file.
+class PatternCandidateCache
+{
+public:
+    explicit PatternCandidateCache(size_t memoryLimit);
+
+    std::shared_ptr<const PatternCandidates> find(uint64_t dictionaryVersion, const Word& pattern);
+    void insert(uint64_t dictionaryVersion, const Word& pattern, std::shared_ptr<const PatternCandidates> candidates);
+    bool load(const std::string& fileName, std::string* outError);
+    bool save(const std::string& fileName, std::string* outError) const;
+    CandidateCacheStats stats() const;
+
+private:
+    struct EntryKey
+    {
+        uint64_t dictionaryVersion;
+        Word pattern;
+
+        bool operator==(const EntryKey& other) const
+        {
+            return dictionaryVersion == other.dictionaryVersion && pattern == other.pattern;
+        }
+    };
+
+    struct EntryKeyHasher
+    {
+        size_t operator()(const EntryKey& key) const
+        {
+            return Word::hasher()(key.pattern) ^ std::hash<uint64_t>()(key.dictionaryVersion);
+        }
+    };
+
+    struct Entry
+    {
+        EntryKey key;
+        std::shared_ptr<const PatternCandidates> candidates;
+        size_t bytes;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    void insertLocked(const EntryKey& key, std::shared_ptr<const PatternCandidates> candidates);
+
+    size_t memoryLimit;
+    mutable std::mutex mutex;
+    EntryList entries;          // most recently used first
+    std::unordered_map<EntryKey, EntryList::iterator, EntryKeyHasher> entryIndex;
+    size_t bytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    std::shared_ptr<const MappedFile> file;
+    std::unordered_map<EntryKey, TextView, EntryKeyHasher> fileIndex;     // serialized entries in file
+};
+
+// Where a climb stands: the root key it climbs from, its pool of best keys with their
+// quality and its random generator written to a stream
+struct ClimbProgress
+{
+    size_t rootIndex = 0;
+    std::vector<std::pair<double, CryptoKeyData>> pool;
+    std::string rngState;
+};
+
+// The state behind SolveCheckpoint
+class CheckpointStore
+{
+public:
+    CheckpointStore(const std::string& fileName, const std::string& ciphertext, SolverMode mode, size_t shardCount, double saveIntervalMs);
+
+    bool load(std::string* outError);
+    bool save(std::string* outError) const;
+
+    bool isShardDone(size_t shardIndex) const;
+    size_t doneShards() const;
+    bool completeShard(size_t shardIndex, const std::vector<RankedKey>& keys, size_t solutions, bool truncated, std::string* outError);
+    std::vector<RankedKey> shardKeys() const;
+    size_t shardSolutions() const;
+    bool isTruncated() const;
+    SearchPass getPass() const;
+    void setNextPass(const SearchPass& nextPass);
+    bool getNextPass(SearchPass& outPass) const;
+    bool startPass(const SearchPass& newPass, std::string* outError);
+
+    // false if no climb was recorded
+    bool getClimb(ClimbProgress& outProgress) const;
+    // true when the climber should hand in its progress, saveIntervalMs after the last save
+    bool isSaveDue() const;
+    // Records the progress and saves it, errors are ignored until the next save
+    void updateClimb(const ClimbProgress& progress);
+
+private:
+    std::string fileName;
+    std::string ciphertext;
+    SolverMode mode;
+    size_t shardCount;
+    double saveIntervalMs;
+    mutable std::mutex mutex;
+    SearchPass pass;
+    bool hasNextPass = false;
+    SearchPass nextPass;
+    std::vector<bool> finishedShards;
+    std::map<std::string, RankedKey> keys;
+    size_t solutions = 0;
+    bool truncated = false;
+    bool hasClimb = false;
+    ClimbProgress climb;
+    std::chrono::steady_clock::time_point lastSave;
+};
+
+// Approximate set of the keys the climbers already walked on, a register-blocked Bloom
+// filter: a key sets bitsPerKey bits of one 64-bit word, so a lookup is one load and one
+// compare. A key found in it is tabu and not scored again. When more keys went in than the
+// filter holds with a low false positive rate it is cleared, which gives the tabu list a
+// tenure. Safe to share between threads, concurrent inserts may lose a key or the count.
+class SeenKeyFilter
+{
+public:
+    explicit SeenKeyFilter(size_t memoryBytes);
+
+    // true if key was (probably) seen before
+    bool test(const CryptoKey& key) const;
+    // marks key as seen
+    void set(const CryptoKey& key);
+    // true if key was (probably) seen before, otherwise it is marked as seen
+    bool testAndSet(const CryptoKey& key);
+
+private:
+    static constexpr unsigned int bitsPerKey = 6;
+
+    void clear();
+    std::atomic<uint64_t>& getWord(const CryptoKey& key, uint64_t& outMask) const;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    size_t numWords;
+    size_t capacity;            // keys until the filter is cleared
+    std::atomic<size_t> numKeys{0};
+};
+
+// Decode sourceText into outText, which holds at least sourceText.size() characters
+template<int NumLetters>
+void transformText(TextView sourceText, const CryptoKey& substitutionKey, char* outText)
+{
+    memcpy(outText, sourceText.data(), sourceText.size());
+    if (substitutionKey.size() == NumLetters)
+    {
+        for (size_t index = 0; index < sourceText.size(); ++index)
+        {
+            const char& chr = sourceText.at(index);
+            if (chr >= 'A' && chr <= 'Z')
+            {
+                outText[index] = substitutionKey.c_str()[chr - 'A'];
+            }
+        }
+    }
+}
+
+template<int NumLetters>
+CryptoText transformText(TextView sourceText, const CryptoKey& substitutionKey)
+{
+    CryptoText retVal(sourceText.size(), ' ');
+    transformText<NumLetters>(sourceText, substitutionKey, &retVal[0]);
+    return retVal;
+}
+
+bool isDictionaryWord(TextView word, const WordList& wordList);
+double calcTextQuality(TextView text, const WordList& wordList);
+
+// Quality of the text decoded by key, buffer has the size class of the text and is
+// reused from call to call
+template<TextSizeClass SizeClass>
+double calcKeyQuality(TextView cryptoText, const CryptoKey& key, const WordList& wordList, TextBuffer<SizeClass>& buffer)
+{
+    transformText<ALPHABET_LETTERS_NUM>(cryptoText, key, buffer.data());
+    return calcTextQuality(buffer.view(), wordList);
+}
+
+// Policies of the hill climber. climbKeys takes them as template parameters, so the
+// mutate, decode and score loop of a walk has no indirect call, and getClimbFunction
+// picks the instantiation for the options once per climb.
+
+// Share of the text letters in dictionary words of the tier
+class WordQualityScorer
+{
+public:
+    explicit WordQualityScorer(const DictionaryTier& tier) : wordList(tier.wordList)
+    {
+    }
+
+    template<TextSizeClass SizeClass>
+    double score(TextView cryptoText, const CryptoKey& key, TextBuffer<SizeClass>& buffer) const
+    {
+        return calcKeyQuality(cryptoText, key, wordList, buffer);
+    }
+
+    // every word of the text is in the dictionary
+    template<TextSizeClass SizeClass>
+    bool isSolved(TextView, const CryptoKey&, double quality, TextBuffer<SizeClass>&) const
+    {
+        return quality >= 1.0;
+    }
+
+private:
+    const WordList& wordList;
+};
+
+// New plain letters drawn by their frequency in the words of the tier, uniformly when it
+// has none. The running sums are built once per climb instead of once per mutation.
+template<int NumLetters>
+class FrequencyMutator
+{
+public:
+    explicit FrequencyMutator(const DictionaryTier& tier)
+    {
+        for(const auto& letter : tier.letterFrequencies)
+        {
+            allLettersNum += letter.second;
+            letters.emplace_back(letter.first);
+            runningSums.emplace_back(allLettersNum);
+        }
+    }
+
+    char pickLetter(std::default_random_engine& rng) const
+    {
+        if (allLettersNum == 0)
+        {
+            std::uniform_int_distribution<int> randomLetter('A', 'A' + NumLetters - 1);
+            return static_cast<char>(randomLetter(rng));
+        }
+        std::uniform_int_distribution<unsigned int> freqDist(0, allLettersNum - 1);
+        const unsigned int rndNew = freqDist(rng);
+        // the first letter whose running sum reaches allLettersNum - rndNew
+        const size_t index = std::lower_bound(runningSums.begin(), runningSums.end(), allLettersNum - rndNew) - runningSums.begin();
+        return letters[index];
+    }
+
+private:
+    unsigned int allLettersNum = 0;
+    std::vector<char> letters;
+    std::vector<unsigned int> runningSums;
+};
+
+// New plain letters drawn uniformly from the alphabet
+template<int NumLetters>
+class UniformMutator
+{
+public:
+    explicit UniformMutator(const DictionaryTier&)
+    {
+    }
+
+    char pickLetter(std::default_random_engine& rng) const
+    {
+        std::uniform_int_distribution<int> randomLetter('A', 'A' + NumLetters - 1);
+        return static_cast<char>(randomLetter(rng));
+    }
+};
+
+// A walk ends with the first key better than the one it started from. Until then it goes
+// on from every mutated key, also from keys the seen-key filter skipped.
+struct RandomWalkAcceptor
+{
+    static bool keepsKey(double, double)
+    {
+        return true;
+    }
+
+    static bool keepsUnscoredKey()
+    {
+        return true;
+    }
+};
+
+// A walk only moves to keys at least as good as its current one, a worse key is undone and
+// the next mutation starts from the current key again. Only the keys a walk moved to are
+// in the seen-key filter, a key it finds there was already walked on and is undone too.
+struct PlateauAcceptor
+{
+    static bool keepsKey(double quality, double walkQuality)
+    {
+        return quality >= walkQuality;
+    }
+
+    static bool keepsUnscoredKey()
+    {
+        return false;
+    }
+};
+
+constexpr size_t maxSegmentWordLength = 20;   // longer words are left out of the segmentation
+// One and two letter entries of the wordlists are mostly abbreviations, they only count
+// as words up to these ranks (A and I, OF to SO and a few more in the default list)
+constexpr WordRank maxSegmentShortWordRank[3] = {0, 32, 128};
+// Value of a letter covered by a word, above the cost of any word so that the best
+// segmentation always covers the most letters and only then prefers frequent words
+constexpr double segmentLetterValue = 32.0;
+// Most cost per letter of the words of a solved text. Sentences of the default wordlist
+// cost 1.1 to 1.9 per letter, covers by rare and short words like TO IF REG SUB A PM WAX more.
+constexpr double maxSolvedSegmentCost = 2.0;
+// Fewer letters have many covers by common words (GOT MY PSI RUN BE AND for THE QUICK
+// BROWN FOX), so a shorter text is never solved: its climb runs to the time limit and
+// reports the best key
+constexpr size_t minSolvedSegmentLetters = 25;
+// Time limit of a climb over a shorter text when the options give none, more time hardly
+// improves its best key
+constexpr double unsolvedSegmentTimeLimitMs = 5000.0;
+
+// Dictionary words by length for segmenting text without word breaks. Every word and all
+// its suffixes are stored reversed as 64-bit hashes in one open addressing table per
+// length, so the dynamic program reads the text backwards from an offset with one probe
+// per length and stops at the first letters no word ends with.
+class SegmentationIndex
+{
+public:
+    struct Entry
+    {
+        uint64_t hash = 0;      // 0 for an empty slot
+        float cost = 0.0f;      // log of the rank of the word, infinite for the suffix of longer words only
+    };
+
+    explicit SegmentationIndex(const WordList& wordList);
+
+    static uint64_t startHash()
+    {
+        return 0xCBF29CE484222325ull;
+    }
+
+    static uint64_t extendHash(uint64_t hash, char chr)
+    {
+        const uint64_t retVal = (hash ^ static_cast<unsigned char>(chr)) * 0x100000001B3ull;
+        return retVal != 0 ? retVal : 1;
+    }
+
+    // nullptr if no word of at least length letters ends with the letters of hash
+    const Entry* find(size_t length, uint64_t hash) const
+    {
+        const Table& table = tables[length];
+        if (table.slots.empty())
+        {
+            return nullptr;
+        }
+        for(size_t slot = (hash * 0x9E3779B97F4A7C15ull) >> table.shift; ; slot = (slot + 1) & (table.slots.size() - 1))
+        {
+            const Entry& entry = table.slots[slot];
+            if (entry.hash == hash)
+            {
+                return &entry;
+            }
+            if (entry.hash == 0)
+            {
+                return nullptr;
+            }
+        }
+    }
+
+private:
+    struct Table
+    {
+        std::vector<Entry> slots;       // size is a power of two, at most half full
+        unsigned int shift = 64;
+    };
+
+    std::array<Table, maxSegmentWordLength + 1> tables;
+};
+
+const SegmentationIndex& getSegmentationIndex(const DictionaryTier& tier);
+// The best segmentation of the letters of text from offset on, values and covered
+// hold the score and the covered letters of every prefix and are kept up to offset.
+// outLengths gets the length of the word ending at every prefix, 0 for an uncovered letter.
+void segmentText(TextView text, size_t offset, const SegmentationIndex& index, std::vector<double>& values,
+                 std::vector<uint32_t>& covered, std::vector<uint8_t>* outLengths = nullptr);
+// Quality of the segmentation of length letters with the given value, and whether it
+// solves the text: all letters covered by words that cost little enough
+double getSegmentationQuality(size_t length, double value);
+bool isSegmentationSolved(size_t length, uint32_t covered, double value);
+// The letters of text with a space between the words of its best segmentation, its
+// quality as SegmentationScorer rates it and whether it solves the text
+std::string getSegmentedText(TextView text, const SegmentationIndex& index, double* outQuality = nullptr, bool* outSolved = nullptr);
+
+// Value of the best segmentation per letter, for patristocrats: the letters in words less
+// the cost of the words. The segmentation of the previous key is kept, a key only
+// resegments the text from the first letter it decodes differently.
+class SegmentationScorer
+{
+public:
+    explicit SegmentationScorer(const DictionaryTier& tier) : index(getSegmentationIndex(tier))
+    {
+    }
+
+    template<TextSizeClass SizeClass>
+    double score(TextView cryptoText, const CryptoKey& key, TextBuffer<SizeClass>& buffer)
+    {
+        transformText<ALPHABET_LETTERS_NUM>(cryptoText, key, buffer.data());
+        return resegment(buffer.view());
+    }
+
+    // Below the quality of the most costly solution no key solves the text, above it a
+    // few uncovered letters of a long text can still score as much, so the key is
+    // segmented again to count them
+    template<TextSizeClass SizeClass>
+    bool isSolved(TextView cryptoText, const CryptoKey& key, double quality, TextBuffer<SizeClass>& buffer)
+    {
+        if (quality < 1.0 - maxSolvedSegmentCost / segmentLetterValue)
+        {
+            return false;
+        }
+        score(cryptoText, key, buffer);
+        return isSegmentationSolved(cryptoText.size(), covered.back(), values.back());
+    }
+
+private:
+    double resegment(TextView text);
+
+    const SegmentationIndex& index;
+    std::string lastText;
+    std::vector<double> values;
+    std::vector<uint32_t> covered;
+};
+
+Word getWordPattern(TextView word);
+LetterPositions getWordLetterPositions(TextView word);
+WordPatternMap createPatternMap(WordList& list);
+CryptoKey getInitialKey();
+ActiveLetters getActiveLetters(TextView text);
+void fixLetters(ActiveLetters& activeLetters, const CryptoKey& rootKey);
+void canonicalizeKey(CryptoKey& key, const ActiveLetters& activeLetters);
+CryptoKey getCommonKeyFromTwoWords(TextView encryptedWord, const Word& decryptedWord);
+CryptoKeyList getMatchingKeys(TextView encryptedWord, const WordList& possibleMatches, WordRankList& outRanks);
+std::shared_ptr<const PatternCandidates> getPatternCandidates(const DictionaryTier& tier, const Word& pattern, PatternCandidateCache* cache);
+CryptoKeyList translatePatternKeys(TextView encryptedWord, const Word& pattern, const CryptoKeyList& patternKeys);
+CryptoKeyList combineTwoKeys(const CryptoKey& key1, const CryptoKey& key2, bool keepBadResults);
+CryptoKeyList combineTwoKeyLists(const CryptoKeyList& keyList1, const CryptoKeyList& keyList2, size_t maxKeys, bool& outTruncated,
+                                 SearchControl* control = nullptr);
+CryptoKeyList combineTwoKeyLists(const CryptoKeyList& keyList1, const CryptoKeyList& keyList2);
+int getNumberOfCommonLetterAssigments(const CryptoKey& key1, const CryptoKey& key2);
+CryptoKeyList combineKeysSuccessOnly(const std::vector<CryptoKeyList>& keyLists, const CombinationList& comboList);
+CryptoKeyList combineKeys(const std::vector<CryptoKeyList>& keyList, const CombinationList& comboList, size_t maxKeys = std::numeric_limits<size_t>::max(),
+                          SearchControl* control = nullptr);
+int getNumberOfCommonLetters(const LetterPositions& positions1, const LetterPositions& positions2);
+Combination planWordOrder(const CryptogramWords& cryptogram);
+CryptoKeyList combineKeysProjected(const std::vector<CryptoKeyList>& keyLists, const std::vector<LetterPositions>& positionsPerWord,
+                                   const Combination& order, size_t maxKeys = std::numeric_limits<size_t>::max(),
+                                   SearchControl* control = nullptr);
+CryptoKeyList combineKeysSmart(const CryptogramWords& cryptogram, size_t maxKeys = std::numeric_limits<size_t>::max(),
+                               SearchControl* control = nullptr);
+CombinationList createAllPermutations(size_t numOfElements);
+CombinationList createSingleCombination(size_t numOfElements);
+void loadWordListIntoSet(const std::string& filename, WordList& outSet, LetterFrequencyMap& freqMap, WordRank firstRank = 0,
+                         uint64_t* outContentHash = nullptr);
+size_t splitLineToWords(TextView line, WordSpans& outWords);
+uint32_t getUsedPlainLetters(const CryptoKey& key);
+CryptoKeyList beamSearchKeys(const CryptogramWords& cryptogram, const Combination& order, const WordList& wordList,
+                             size_t beamWidth, size_t maxKeys, SearchControl& control);
+CryptoKeyList bestFirstSearchKeys(const CryptogramWords& cryptogram, const Combination& order, const WordList& wordList,
+                                  size_t maxSolutions, size_t maxKeys, const SolutionCallback& onSolution, SearchControl& control);
+template<typename Mutator>
+CryptoKeyData MutateKey(const CryptoKeyData& sourceKeyData, std::set<char>& goodPos, const Mutator& mutator, const ActiveLetters& activeLetters,
+                        std::default_random_engine& rng);
+template<int NumLetters>
+void addRandomKey(CryptoKeySet& outSet, const ActiveLetters& activeLetters, std::default_random_engine& rng);
+template<TextSizeClass SizeClass, typename Scorer, typename Mutator, typename Acceptor>
+void addOneBetterSolution(SolutionMap& sMap, const CryptoKeyData& initialKey, TextView cryptoText,
+                          Scorer& scorer, const Mutator& mutator, const ActiveLetters& activeLetters,
+                          std::default_random_engine& rng, SearchControl* control = nullptr, SeenKeyFilter* seenKeys = nullptr);
+template<TextSizeClass SizeClass, typename Scorer, typename Mutator, typename Acceptor>
+CryptoKeyList climbKeys(TextView cryptoText, const DictionaryTier& tier, SearchControl& control, const CryptoKey& rootKey,
+                        SeenKeyFilter* seenKeys, size_t rootIndex, unsigned int seed);
+using ClimbFunction = CryptoKeyList (*)(TextView cryptoText, const DictionaryTier& tier, SearchControl& control, const CryptoKey& rootKey,
+                                        SeenKeyFilter* seenKeys, size_t rootIndex, unsigned int seed);
+// The climbKeys instantiation for the size class of the text, the mode and the policies of
+// the options
+ClimbFunction getClimbFunction(TextSizeClass sizeClass, const SolverOptions& options);
+
+Dictionary createDictionary(const std::vector<std::string>& fileNames);
+const DictionaryTier& loadDictionaryTier(const Dictionary& dictionary, size_t tierIndex);
+CryptogramWords prepareCryptogramWords(TextView text, const Dictionary& dictionary, size_t firstTier,
+                                       PatternCandidateCache* cache = nullptr, SolverMetrics* metrics = nullptr);
+CryptogramWords selectShard(const CryptogramWords& cryptogram, size_t shardIndex, size_t shardCount);
+CryptoKeyList searchKeys(const CryptogramWords& cryptogram, const WordList& wordList, const SolverOptions& options, size_t maxKeys,
+                         const SolutionCallback& onSolution, SearchControl& control);
+CryptoKeyList searchKeysWithUnknownWords(CryptogramWords& cryptogram, const WordList& wordList, const SolverOptions& options,
+                                         const std::vector<size_t>& unknownWords, size_t maxKeys, const SolutionCallback& onSolution,
+                                         SearchControl& control);
+bool getNextSearchPass(const CryptogramWords& cryptogram, size_t lastTier, size_t maxUnknownWords, SearchPass& inOutPass);
+bool getRootKeys(TextView text, const SolverOptions& options, CryptoKeyList& outRootKeys, std::string& outError);
+CryptogramWords constrainCryptogramWords(const CryptogramWords& cryptogram, const CryptoKey& rootKey);
+CryptoKeyList searchKeysFromRoots(const CryptogramWords& cryptogram, const CryptoKeyList& rootKeys, const WordList& wordList,
+                                  const SolverOptions& options, const std::vector<size_t>& unknownWords, size_t maxKeys,
+                                  const SolutionCallback& onSolution, SearchControl& control);
+CryptoKeyList searchKeysInTiers(TextView text, const Dictionary& dictionary, const SolverOptions& options, const CryptoKeyList& rootKeys,
+                                size_t maxKeys, const SolutionCallback& onSolution, SearchControl& control, size_t& outTier,
+                                bool& outHasNextPass, SearchPass& outNextPass);
+bool isSupportedCryptogram(const std::string& text);
+
+#endif
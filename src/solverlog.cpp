@@ -0,0 +1,268 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "solverlog.h"
+
+// -1 while there is no stream, so no level is logged
+std::atomic<int> solverLogLevel(-1);
+
+void LogMessage::addArg(const char* value, size_t length)
+{
+    if (numArgs < maxLogArgs)
+    {
+        // text beyond the space of the message is cut off
+        const size_t copied = std::min(length, maxLogText - textLength);
+        memcpy(text + textLength, value, copied);
+        LogArg& arg = args[numArgs++];
+        arg.type = LogArgType::Text;
+        arg.text.offset = textLength;
+        arg.text.length = static_cast<uint16_t>(copied);
+        textLength += static_cast<uint16_t>(copied);
+    }
+}
+
+void LogMessage::addArg(double value)
+{
+    if (numArgs < maxLogArgs)
+    {
+        LogArg& arg = args[numArgs++];
+        arg.type = LogArgType::Real;
+        arg.realValue = value;
+    }
+}
+
+std::string LogMessage::formatText() const
+{
+    std::ostringstream stream;
+    size_t argIndex = 0;
+    for(const char* chr = format; *chr; ++chr)
+    {
+        const char* end = *chr == '{' ? strchr(chr, '}') : nullptr;
+        if (!end)
+        {
+            stream << *chr;
+            continue;
+        }
+        int width = 0;
+        int precision = -1;
+        if (chr[1] == ':')
+        {
+            if (chr[2] == '.')
+            {
+                precision = atoi(chr + 3);
+            }
+            else
+            {
+                width = atoi(chr + 2);
+            }
+        }
+        chr = end;
+        if (argIndex >= numArgs)
+        {
+            continue;
+        }
+        const LogArg& arg = args[argIndex++];
+        stream << std::setw(width);
+        switch (arg.type)
+        {
+        case LogArgType::Signed:
+            stream << arg.signedValue;
+            break;
+        case LogArgType::Unsigned:
+            stream << arg.unsignedValue;
+            break;
+        case LogArgType::Real:
+            if (precision >= 0)
+            {
+                stream << std::fixed << std::setprecision(precision) << arg.realValue;
+                stream.unsetf(std::ios_base::floatfield);
+            }
+            else
+            {
+                stream << arg.realValue;
+            }
+            break;
+        case LogArgType::Text:
+            stream << std::string(text + arg.text.offset, arg.text.length);
+            break;
+        }
+    }
+    return stream.str();
+}
+
+// Bounded multi-producer ring, every slot carries the sequence number that tells whether
+// it is free for the producer of a position or filled for the writer. Only setStream,
+// flush and the writer thread take the mutex, the producers never do.
+class LogWriter
+{
+public:
+    LogWriter() : ring(new Slot[ringSize])
+    {
+        for(size_t index = 0; index < ringSize; ++index)
+        {
+            ring[index].sequence = index;
+        }
+    }
+
+    ~LogWriter()
+    {
+        setStream(nullptr, LogLevel::Error);
+    }
+
+    void push(const LogMessage& message)
+    {
+        size_t position = writePosition.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot& slot = ring[position & (ringSize - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == position)
+            {
+                if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.message = message;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return;
+                }
+            }
+            else if (sequence < position)
+            {
+                // the writer did not free this slot yet, the ring is full
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+            {
+                position = writePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void setStream(std::ostream* newStream, LogLevel level)
+    {
+        if (!newStream)
+        {
+            solverLogLevel = -1;
+        }
+        flush();
+        std::unique_lock<std::mutex> lock(mutex);
+        stream = newStream;
+        if (!stream && writer.joinable())
+        {
+            stopping = true;
+            wakeUp.notify_one();
+            lock.unlock();
+            writer.join();
+            lock.lock();
+            stopping = false;
+        }
+        else if (stream && !writer.joinable())
+        {
+            writer = std::thread(&LogWriter::run, this);
+        }
+        if (stream)
+        {
+            solverLogLevel = static_cast<int>(level);
+        }
+    }
+
+    void flush()
+    {
+        const size_t target = writePosition.load();
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!writer.joinable())
+        {
+            return;
+        }
+        wakeUp.notify_one();
+        written.wait(lock, [&]() { return readPosition >= target; });
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        LogMessage message;
+    };
+
+    static constexpr size_t ringSize = 1024;        // a power of two
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            writePending();
+            wakeUp.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        writePending();
+    }
+
+    // called with the mutex held
+    void writePending()
+    {
+        bool wroteAny = false;
+        for(;;)
+        {
+            Slot& slot = ring[readPosition & (ringSize - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1)
+            {
+                break;
+            }
+            if (stream)
+            {
+                *stream << slot.message.formatText();
+                wroteAny = true;
+            }
+            slot.sequence.store(readPosition + ringSize, std::memory_order_release);
+            ++readPosition;
+        }
+        const size_t droppedNow = dropped.exchange(0, std::memory_order_relaxed);
+        if (stream && droppedNow > 0)
+        {
+            *stream << droppedNow << " log messages dropped" << '\n';
+            wroteAny = true;
+        }
+        if (wroteAny)
+        {
+            stream->flush();
+        }
+        written.notify_all();
+    }
+
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<size_t> writePosition{0};
+    size_t readPosition = 0;            // guarded by mutex
+    std::atomic<size_t> dropped{0};
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable written;
+    std::ostream* stream = nullptr;
+    std::thread writer;
+    bool stopping = false;
+};
+
+LogWriter& getLogWriter()
+{
+    static LogWriter writer;
+    return writer;
+}
+
+void queueLogMessage(const LogMessage& message)
+{
+    getLogWriter().push(message);
+}
+
+void setSolverLog(std::ostream* stream, LogLevel level)
+{
+    getLogWriter().setStream(stream, level);
+}
+
+void flushSolverLog()
+{
+    getLogWriter().flush();
+}
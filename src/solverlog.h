@@ -0,0 +1,131 @@
+#ifndef _SOLVERLOG_H_
+#define _SOLVERLOG_H_
+
+// Asynchronous progress log of the engines. A message is its format string and the values
+// of its arguments, copied into a slot of a lock-free ring buffer. A background thread
+// formats the messages and writes them to the stream of setSolverLog, so workers never
+// wait for the stream. When the ring is full the message is dropped and counted.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string.h>
+#include <type_traits>
+#include "fastcryptosolver.h"
+
+constexpr size_t maxLogArgs = 8;
+constexpr size_t maxLogText = 384;      // bytes of all text arguments of one message
+
+enum class LogArgType : uint8_t
+{
+    Signed,
+    Unsigned,
+    Real,
+    Text
+};
+
+struct LogArg
+{
+    LogArgType type;
+    union
+    {
+        long long signedValue;
+        unsigned long long unsignedValue;
+        double realValue;
+        struct
+        {
+            uint16_t offset;
+            uint16_t length;
+        } text;
+    };
+};
+
+// Placeholders in format: {} for the next argument, {:.N} for a real with N decimals and
+// {:N} for a right-aligned field of width N. format has to be a string literal.
+struct LogMessage
+{
+    LogLevel level = LogLevel::Info;
+    const char* format = "";
+    uint8_t numArgs = 0;
+    uint16_t textLength = 0;
+    LogArg args[maxLogArgs];
+    char text[maxLogText];
+
+    void addArg(const char* value, size_t length);
+    void addArg(const std::string& value)
+    {
+        addArg(value.data(), value.size());
+    }
+    void addArg(const char* value)
+    {
+        addArg(value, strlen(value));
+    }
+    void addArg(char value)
+    {
+        addArg(&value, 1);
+    }
+    void addArg(double value);
+    template<typename Integer>
+    typename std::enable_if<std::is_integral<Integer>::value>::type addArg(Integer value)
+    {
+        if (numArgs < maxLogArgs)
+        {
+            LogArg& arg = args[numArgs++];
+            if (std::is_signed<Integer>::value)
+            {
+                arg.type = LogArgType::Signed;
+                arg.signedValue = static_cast<long long>(value);
+            }
+            else
+            {
+                arg.type = LogArgType::Unsigned;
+                arg.unsignedValue = static_cast<unsigned long long>(value);
+            }
+        }
+    }
+    // views like TextView
+    template<typename Text>
+    auto addArg(const Text& value) -> decltype(value.data(), value.size(), void())
+    {
+        addArg(value.data(), value.size());
+    }
+
+    std::string formatText() const;
+};
+
+extern std::atomic<int> solverLogLevel;
+
+inline bool isLogEnabled(LogLevel level)
+{
+    return static_cast<int>(level) <= solverLogLevel.load(std::memory_order_relaxed);
+}
+
+void queueLogMessage(const LogMessage& message);
+
+inline void addLogArgs(LogMessage&)
+{
+}
+
+template<typename First, typename... Rest>
+void addLogArgs(LogMessage& message, const First& first, const Rest&... rest)
+{
+    message.addArg(first);
+    addLogArgs(message, rest...);
+}
+
+// Does nothing but the level check when the level is not logged
+template<typename... Args>
+void logMessage(LogLevel level, const char* format, const Args&... args)
+{
+    if (!isLogEnabled(level))
+    {
+        return;
+    }
+    LogMessage message;
+    message.level = level;
+    message.format = format;
+    addLogArgs(message, args...);
+    queueLogMessage(message);
+}
+
+#endif